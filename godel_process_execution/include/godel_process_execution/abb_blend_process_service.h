@@ -4,6 +4,9 @@
 #include <ros/ros.h>
 #include <godel_msgs/ProcessExecutionAction.h>
 #include <actionlib/server/simple_action_server.h>
+#include <godel_utils/joint_state_cache.h>
+#include <memory>
+#include <set>
 
 namespace godel_process_execution
 {
@@ -23,11 +26,20 @@ public:
   bool simulateProcess(const godel_msgs::ProcessExecutionGoalConstPtr &goal);
 
 private:
+  // Modules already stored on the controller, by file name. Backed by the file at 'manifest_path_', if set,
+  // so that they survive a restart of this node.
+  void loadModuleManifest();
+  void addToModuleManifest(const std::string& name);
+  void removeFromModuleManifest(const std::string& name);
+
   ros::NodeHandle nh_;
   ros::ServiceClient real_client_;
   ros::ServiceClient sim_client_;
   actionlib::SimpleActionServer<godel_msgs::ProcessExecutionAction> process_exe_action_server_;
+  std::unique_ptr<godel_utils::JointStateCache> joint_states_;
   bool j23_coupled_;
+  std::set<std::string> stored_modules_;
+  std::string manifest_path_;
 };
 }
 
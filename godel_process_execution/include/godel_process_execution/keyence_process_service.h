@@ -4,6 +4,8 @@
 #include <ros/ros.h>
 #include <actionlib/server/simple_action_server.h>
 #include <godel_msgs/ProcessExecutionAction.h>
+#include <godel_utils/joint_state_cache.h>
+#include <memory>
 
 namespace godel_process_execution
 {
@@ -23,12 +25,22 @@ public:
   bool simulateProcess(const godel_msgs::ProcessExecutionGoalConstPtr &goal);
 
 private:
+  // runs 'traj' with the laser on
+  bool executeScan(const trajectory_msgs::JointTrajectory& traj);
+  // runs approach, process and depart as one trajectory, switching the laser as the robot crosses the
+  // scan segment boundaries
+  bool executeContinuousScan(const godel_msgs::ProcessExecutionGoalConstPtr &goal);
+  bool setLaser(bool on);
+  bool executeTrajectory(const trajectory_msgs::JointTrajectory& traj, const std::string& description);
+
   ros::NodeHandle nh_;
   ros::ServiceClient real_client_;
   ros::ServiceClient sim_client_;
   actionlib::SimpleActionServer<godel_msgs::ProcessExecutionAction> process_exe_action_server_;
   ros::ServiceClient keyence_client_;
   ros::ServiceClient reset_scan_server_;
+  std::unique_ptr<godel_utils::JointStateCache> joint_states_;
+  bool continuous_scan_;
 };
 }
 
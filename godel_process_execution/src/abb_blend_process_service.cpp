@@ -3,19 +3,19 @@
 #include <industrial_robot_simulator_service/SimulateTrajectory.h>
 #include <moveit_msgs/ExecuteKnownTrajectory.h>
 
+#include <algorithm>
+#include <cstdint>
 #include <fstream>
+#include <iomanip>
+#include <sstream>
 
 #include "process_utils.h"
 #include "rapid_generator/rapid_emitter.h"
 #include "abb_file_suite/ExecuteProgram.h"
 #include <godel_utils/ensenso_guard.h>
 
-// hack
-#include "sensor_msgs/JointState.h"
-#include "ros/topic.h"
-
-const static double DEFAULT_JOINT_TOPIC_WAIT_TIME = 5.0; // seconds
 const static double DEFAULT_TRAJECTORY_BUFFER_TIME = 5.0; // seconds
+const static double MODULE_START_TIMEOUT = 5.0; // (s) for the robot to leave its start pose once a module is run
 const static std::string JOINT_TOPIC_NAME = "/joint_states";
 
 const static std::string THIS_SERVICE_NAME = "blend_process_execution";
@@ -42,34 +42,41 @@ static inline bool compare(const std::vector<double>& a, const std::vector<doubl
   return diff < eps;
 }
 
-static bool waitForExecution(const std::vector<double>& end_goal, const ros::Duration& wait_for,
-                             const ros::Duration& time_out)
+static bool waitForExecution(const godel_utils::JointStateCache& joint_states, const std::vector<double>& end_goal,
+                             const ros::Duration& wait_for, const ros::Duration& time_out)
 {
   ensenso::EnsensoGuard guard;
-  sensor_msgs::JointStateConstPtr state;
-  ros::Time end_time = ros::Time::now() + time_out;
 
   // wait a fixed amount of time
   wait_for.sleep();
 
-  while (ros::Time::now() < end_time)
+  if (!joint_states.latest())
   {
-    state = ros::topic::waitForMessage<sensor_msgs::JointState>(
-        JOINT_TOPIC_NAME, ros::Duration(DEFAULT_JOINT_TOPIC_WAIT_TIME));
-    if (!state)
-    {
-      ROS_WARN("Could not get a joint_state in time");
-      return false;
-    }
-    if (compare(state->position, end_goal))
-    {
-      ROS_INFO("Goal in tolerance. Returning control.");
-      return true;
-    }
+    ROS_WARN("No joint_state has been received yet");
+  }
+
+  // wait out the rest of the time out for the robot to arrive
+  const ros::Duration remaining = time_out - wait_for;
+  const auto arrived = joint_states.waitFor(
+      [&end_goal](const sensor_msgs::JointState& state) { return compare(state.position, end_goal); },
+      ros::WallDuration(std::max(remaining.toSec(), 0.0)));
+
+  if (arrived)
+  {
+    ROS_INFO("Goal in tolerance. Returning control.");
+    return true;
   }
   return false;
 }
 
+// True once the robot has left \e start, i.e. the controller is running the module it was sent
+static bool waitForStart(const godel_utils::JointStateCache& joint_states, const std::vector<double>& start,
+                         const ros::WallDuration& time_out)
+{
+  return static_cast<bool>(joint_states.waitFor(
+      [&start](const sensor_msgs::JointState& state) { return !compare(state.position, start); }, time_out));
+}
+
 static double toDegrees(double rads) { return rads * 180.0 / M_PI; }
 
 static std::vector<double> toDegrees(const std::vector<double>& rads)
@@ -117,36 +124,48 @@ toRapidTrajectory(const trajectory_msgs::JointTrajectory& traj, bool j23_coupled
   return rapid_pts;
 }
 
-static bool writeRapidFile(const std::string& path,
-                           const std::vector<rapid_emitter::TrajectoryPt>& traj,
-                           unsigned process_start, unsigned process_stop,
-                           const rapid_emitter::ProcessParams& params)
+static bool generateRapidModule(const std::vector<rapid_emitter::TrajectoryPt>& traj,
+                                unsigned process_start, unsigned process_stop,
+                                const rapid_emitter::ProcessParams& params, std::string& module)
 {
-  std::ofstream fp("/tmp/blend.mod");
-  if (!fp)
+  std::ostringstream ss;
+  if (!rapid_emitter::emitRapidFile(ss, traj, process_start, process_stop, params))
   {
-    ROS_ERROR_STREAM("Unable to create file: " << path);
+    ROS_ERROR("Unable to write RAPID module for blending process.");
     return false;
   }
 
-  if (!rapid_emitter::emitRapidFile(fp, traj, process_start, process_stop, params))
+  module = ss.str();
+  return true;
+}
+
+// Names a module after its contents (64 bit FNV-1a), so an unchanged plan maps to the module already on the
+// controller
+static std::string moduleName(const std::string& module)
+{
+  std::uint64_t hash = 14695981039346656037ULL;
+  for (const char c : module)
   {
-    ROS_ERROR("Unable to write to RAPID file for blending process.");
-    return false;
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ULL;
   }
 
-  fp.flush();
-  return true;
+  std::ostringstream ss;
+  ss << "mGodel" << std::hex << std::setw(16) << std::setfill('0') << hash << ".mod";
+  return ss.str();
 }
 
 godel_process_execution::AbbBlendProcessService::AbbBlendProcessService(ros::NodeHandle& nh) : nh_(nh),
   process_exe_action_server_(nh_,
                            PROCESS_EXE_ACTION_SERVER_NAME,
                            boost::bind(&godel_process_execution::AbbBlendProcessService::executionCallback, this, _1),
-                           false)
+                           false),
+  joint_states_(new godel_utils::JointStateCache(JOINT_TOPIC_NAME))
 {
   // Load Robot Specific Parameters
   nh_.param<bool>("J23_coupled", j23_coupled_, false);
+  ros::NodeHandle("~").param<std::string>("module_manifest", manifest_path_, "");
+  loadModuleManifest();
 
   // Create client services
   sim_client_ = nh_.serviceClient<industrial_robot_simulator_service::SimulateTrajectory>(SIMULATION_SERVICE_NAME);
@@ -192,27 +211,54 @@ bool godel_process_execution::AbbBlendProcessService::executeProcess(
   unsigned start_index = goal->trajectory_approach.points.size();
   unsigned stop_index = start_index + goal->trajectory_process.points.size();
 
-  if (!writeRapidFile("/tmp/blend.mod", pts, start_index, stop_index, params))
+  // Call the ABB driver, handing it the module text so that nothing touches the disk
+  std::string program;
+  if (!generateRapidModule(pts, start_index, stop_index, params, program))
   {
-    ROS_ERROR("Unable to generate RAPID motion file; Cannot execute process.");
+    ROS_ERROR("Unable to generate RAPID motion module; Cannot execute process.");
     return false;
   }
 
-  // Call the ABB driver
-
+  // A module the controller already holds is only triggered; the controller keeps the last one loaded
   abb_file_suite::ExecuteProgram srv;
-  srv.request.file_path = "/tmp/blend.mod";
+  srv.request.module_name = moduleName(program);
+  const bool stored = stored_modules_.count(srv.request.module_name) > 0;
+  if (stored)
+  {
+    ROS_INFO_STREAM("RAPID module " << srv.request.module_name << " is already on the controller; skipping upload.");
+  }
+  else
+  {
+    srv.request.program = program;
+  }
 
   if (!real_client_.call(srv))
   {
     ROS_ERROR("Unable to upload blending process RAPID module to controller via FTP.");
+    removeFromModuleManifest(srv.request.module_name);
     return false;
   }
 
+  // The controller skips modules missing from its store, e.g. after its files were cleaned up, and the robot
+  // then never leaves its start pose. Such a module is forgotten and uploaded again.
+  const std::vector<double>& start = aggregate_traj.points.front().positions;
+  if (stored && !waitForStart(*joint_states_, start, ros::WallDuration(MODULE_START_TIMEOUT)))
+  {
+    ROS_WARN_STREAM("RAPID module " << srv.request.module_name << " did not run; uploading it again.");
+    removeFromModuleManifest(srv.request.module_name);
+    srv.request.program = program;
+    if (!real_client_.call(srv))
+    {
+      ROS_ERROR("Unable to upload blending process RAPID module to controller via FTP.");
+      return false;
+    }
+  }
+  addToModuleManifest(srv.request.module_name);
+
   if (goal->wait_for_execution)
   {
     // If we must wait for execution, then block and listen until robot returns to initial point or times out
-    return waitForExecution(goal->trajectory_approach.points.front().positions,
+    return waitForExecution(*joint_states_, goal->trajectory_approach.points.front().positions,
                             aggregate_traj.points.back().time_from_start, // wait for
                             aggregate_traj.points.back().time_from_start +
                                 ros::Duration(DEFAULT_TRAJECTORY_BUFFER_TIME)); // timeout
@@ -223,6 +269,54 @@ bool godel_process_execution::AbbBlendProcessService::executeProcess(
   }
 }
 
+void godel_process_execution::AbbBlendProcessService::loadModuleManifest()
+{
+  if (manifest_path_.empty())
+  {
+    return;
+  }
+
+  std::ifstream ifh(manifest_path_.c_str());
+  std::string name;
+  while (ifh >> name)
+  {
+    stored_modules_.insert(name);
+  }
+  ROS_INFO_STREAM("Loaded " << stored_modules_.size() << " stored RAPID modules from " << manifest_path_);
+}
+
+void godel_process_execution::AbbBlendProcessService::addToModuleManifest(const std::string& name)
+{
+  if (!stored_modules_.insert(name).second || manifest_path_.empty())
+  {
+    return;
+  }
+
+  std::ofstream ofh(manifest_path_.c_str(), std::ios::app);
+  if (!(ofh << name << '\n'))
+  {
+    ROS_WARN_STREAM("Unable to record RAPID module in manifest: " << manifest_path_);
+  }
+}
+
+void godel_process_execution::AbbBlendProcessService::removeFromModuleManifest(const std::string& name)
+{
+  if (stored_modules_.erase(name) == 0 || manifest_path_.empty())
+  {
+    return;
+  }
+
+  std::ofstream ofh(manifest_path_.c_str(), std::ios::trunc);
+  for (const auto& stored : stored_modules_)
+  {
+    ofh << stored << '\n';
+  }
+  if (!ofh)
+  {
+    ROS_WARN_STREAM("Unable to rewrite RAPID module manifest: " << manifest_path_);
+  }
+}
+
 bool godel_process_execution::AbbBlendProcessService::simulateProcess(
     const godel_msgs::ProcessExecutionGoalConstPtr &goal)
 {
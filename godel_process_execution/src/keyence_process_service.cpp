@@ -14,6 +14,9 @@
 
 #include <ros/topic.h>
 
+#include <algorithm>
+#include <cmath>
+
 const static int KEYENCE_PROGRAM_LASER_ON = 1;
 const static int KEYENCE_PROGRAM_LASER_OFF = 0;
 
@@ -23,13 +26,24 @@ const static std::string SIMULATION_SERVICE_NAME = "simulate_path";
 const static std::string SERVICE_SERVER_NAME = "scan_process_execution";
 const static std::string RESET_SCANS_SERVICE = "reset_scan_server";
 const static std::string PROCESS_EXE_ACTION_SERVER_NAME = "scan_process_execution_as";
+const static std::string JOINT_TOPIC_NAME = "/joint_states";
+
+// Continuous scanning
+const static double LASER_LEAD_TIME = 0.05;      // [s] switch the laser this far ahead of a segment boundary
+const static double PROGRESS_POLL_RATE = 100.0;  // [Hz]
+const static std::size_t PROGRESS_WINDOW = 20;   // trajectory points ahead of the robot searched for its position
+const static double GOAL_TOLERANCE = 0.01;       // [rad] summed over the joints, as the blend service checks arrival
+const static double EXECUTION_TIMEOUT_RATIO = 2.0; // of the trajectory duration, past its end
 
 godel_process_execution::KeyenceProcessService::KeyenceProcessService(ros::NodeHandle& nh) : nh_(nh),
   process_exe_action_server_(nh_,
                            PROCESS_EXE_ACTION_SERVER_NAME,
                            boost::bind(&godel_process_execution::KeyenceProcessService::executionCallback, this, _1),
-                           false)
+                           false),
+  joint_states_(new godel_utils::JointStateCache(JOINT_TOPIC_NAME))
 {
+  ros::NodeHandle("~").param<bool>("continuous_scan", continuous_scan_, false);
+
   // Connect to motion servers and I/O server
   sim_client_ = nh.serviceClient<industrial_robot_simulator_service::SimulateTrajectory>(
       SIMULATION_SERVICE_NAME);
@@ -66,6 +80,7 @@ void godel_process_execution::KeyenceProcessService::executionCallback(
       res.success = true;
     }
   }
+  process_exe_action_server_.setSucceeded(res);
 }
 
 bool godel_process_execution::KeyenceProcessService::executeProcess(
@@ -84,52 +99,205 @@ bool godel_process_execution::KeyenceProcessService::executeProcess(
   std_srvs::Trigger dummy_trigger;
   reset_scan_server_.call(dummy_trigger);
 
-  // Prepare the trajectories to run
-  godel_msgs::TrajectoryExecution srv_approach;
-  srv_approach.request.wait_for_execution = true;
-  srv_approach.request.trajectory = goal->trajectory_approach;
+  if (continuous_scan_)
+  {
+    return executeContinuousScan(goal);
+  }
 
-  godel_msgs::TrajectoryExecution srv_process;
-  srv_process.request.wait_for_execution = true;
-  srv_process.request.trajectory = goal->trajectory_process;
+  if (!executeTrajectory(goal->trajectory_approach, "approach"))
+  {
+    return false;
+  }
 
-  godel_msgs::TrajectoryExecution srv_depart;
-  srv_depart.request.wait_for_execution = true;
-  srv_depart.request.trajectory = goal->trajectory_depart;
+  // Without scan segments the laser is on for the whole process trajectory. Otherwise it is only on
+  // over each segment and the traverses between segments run with the laser off.
+  const trajectory_msgs::JointTrajectory& process = goal->trajectory_process;
+  if (goal->scan_segment_starts.empty())
+  {
+    return executeScan(process) && executeTrajectory(goal->trajectory_depart, "departure");
+  }
 
-  if (!real_client_.call(srv_approach))
+  if (goal->scan_segment_starts.size() != goal->scan_segment_stops.size() || process.points.empty())
   {
-    ROS_ERROR("Execution client unavailable or unable to execute approach trajectory.");
+    ROS_ERROR("Scan segments do not match the process trajectory.");
     return false;
   }
 
-  keyence_experimental::ChangeProgram keyence_srv;
-  keyence_srv.request.program_no = KEYENCE_PROGRAM_LASER_ON;
+  const std::size_t last = process.points.size() - 1;
+  std::size_t cursor = 0;
+  for (std::size_t i = 0; i < goal->scan_segment_starts.size(); ++i)
+  {
+    const std::size_t start = std::min<std::size_t>(goal->scan_segment_starts[i], last);
+    const std::size_t stop = std::min<std::size_t>(goal->scan_segment_stops[i], last);
+    if (start > cursor && !executeTrajectory(extractTrajectory(process, cursor, start), "traverse"))
+    {
+      return false;
+    }
 
-  if (!keyence_client_.call(keyence_srv))
+    if (!executeScan(extractTrajectory(process, start, stop)))
+    {
+      return false;
+    }
+    cursor = std::max(cursor, stop);
+  }
+
+  if (cursor < last && !executeTrajectory(extractTrajectory(process, cursor, last), "traverse"))
   {
-    ROS_ERROR_STREAM("Unable to activate keyence (program " << KEYENCE_PROGRAM_LASER_ON << ").");
     return false;
   }
 
-  if (!real_client_.call(srv_process))
+  return executeTrajectory(goal->trajectory_depart, "departure");
+}
+
+bool godel_process_execution::KeyenceProcessService::executeScan(const trajectory_msgs::JointTrajectory& traj)
+{
+  return setLaser(true) && executeTrajectory(traj, "process") && setLaser(false);
+}
+
+bool godel_process_execution::KeyenceProcessService::executeContinuousScan(
+    const godel_msgs::ProcessExecutionGoalConstPtr &goal)
+{
+  const trajectory_msgs::JointTrajectory& process = goal->trajectory_process;
+  if (goal->scan_segment_starts.size() != goal->scan_segment_stops.size() || process.points.empty())
   {
-    ROS_ERROR("Execution client unavailable or unable to execute process trajectory.");
+    ROS_ERROR("Scan segments do not match the process trajectory.");
     return false;
   }
 
-  // Turn keyence off
-  keyence_srv.request.program_no = KEYENCE_PROGRAM_LASER_OFF;
+  trajectory_msgs::JointTrajectory traj = goal->trajectory_approach;
+  const std::size_t offset = joinTrajectory(traj, process);
+  joinTrajectory(traj, goal->trajectory_depart);
+
+  // Times along the joined trajectory at which the laser goes on and off; without scan segments the laser is
+  // on for the whole process trajectory
+  const std::size_t last = process.points.size() - 1;
+  std::vector<std::pair<double, double> > gates;
+  if (goal->scan_segment_starts.empty())
+  {
+    gates.push_back(std::make_pair(traj.points[offset].time_from_start.toSec(),
+                                   traj.points[offset + last].time_from_start.toSec()));
+  }
+  for (std::size_t i = 0; i < goal->scan_segment_starts.size(); ++i)
+  {
+    const std::size_t start = offset + std::min<std::size_t>(goal->scan_segment_starts[i], last);
+    const std::size_t stop = offset + std::min<std::size_t>(goal->scan_segment_stops[i], last);
+    gates.push_back(std::make_pair(traj.points[start].time_from_start.toSec(),
+                                   traj.points[stop].time_from_start.toSec()));
+  }
+
+  // Joint states may list more joints, or list them in another order, than the trajectory
+  std::vector<std::size_t> joint_index;
+  auto distance_to = [&traj, &joint_index](const sensor_msgs::JointState& state, std::size_t i) {
+    if (joint_index.empty())
+    {
+      for (std::size_t j = 0; j < traj.joint_names.size(); ++j)
+      {
+        const auto it = std::find(state.name.begin(), state.name.end(), traj.joint_names[j]);
+        joint_index.push_back(it == state.name.end() ? j : static_cast<std::size_t>(it - state.name.begin()));
+      }
+      for (std::size_t j = joint_index.size(); j < traj.points[i].positions.size(); ++j)
+        joint_index.push_back(j);
+    }
+
+    double diff = 0.0;
+    for (std::size_t j = 0; j < traj.points[i].positions.size(); ++j)
+    {
+      if (joint_index[j] < state.position.size())
+        diff += std::abs(state.position[joint_index[j]] - traj.points[i].positions[j]);
+    }
+    return diff;
+  };
+
+  godel_msgs::TrajectoryExecution srv;
+  srv.request.wait_for_execution = false;
+  srv.request.trajectory = traj;
+  if (!real_client_.call(srv))
+  {
+    ROS_ERROR("Execution client unavailable or unable to execute scan trajectory.");
+    return false;
+  }
+
+  // Follow the robot along the trajectory and switch the laser as its progress crosses the gates
+  const double duration = traj.points.back().time_from_start.toSec();
+  const ros::Time deadline = ros::Time::now() + ros::Duration(duration * (1.0 + EXECUTION_TIMEOUT_RATIO));
+  std::size_t progress = 0;
+  std::size_t gate = 0;
+  bool laser_on = false;
+  ros::Rate rate(PROGRESS_POLL_RATE);
+
+  while (ros::ok() && ros::Time::now() < deadline)
+  {
+    const sensor_msgs::JointStateConstPtr state = joint_states_->latest();
+    if (state)
+    {
+      // The robot only moves forward along the trajectory, so only the points just ahead are candidates
+      double best = distance_to(*state, progress);
+      const std::size_t window_end = std::min(progress + PROGRESS_WINDOW, traj.points.size() - 1);
+      for (std::size_t i = progress + 1; i <= window_end; ++i)
+      {
+        const double d = distance_to(*state, i);
+        if (d < best)
+        {
+          best = d;
+          progress = i;
+        }
+      }
+
+      const double t = traj.points[progress].time_from_start.toSec();
+      if (gate < gates.size() && !laser_on && t >= gates[gate].first - LASER_LEAD_TIME)
+      {
+        if (!setLaser(true))
+          return false;
+        laser_on = true;
+      }
+      if (gate < gates.size() && laser_on && t >= gates[gate].second - LASER_LEAD_TIME)
+      {
+        if (!setLaser(false))
+          return false;
+        laser_on = false;
+        ++gate;
+      }
+
+      if (progress == traj.points.size() - 1 && best < GOAL_TOLERANCE)
+      {
+        return gate == gates.size();
+      }
+    }
+    rate.sleep();
+  }
+
+  ROS_ERROR("Scan trajectory did not complete in time.");
+  if (laser_on)
+  {
+    setLaser(false);
+  }
+  return false;
+}
+
+bool godel_process_execution::KeyenceProcessService::setLaser(bool on)
+{
+  keyence_experimental::ChangeProgram keyence_srv;
+  keyence_srv.request.program_no = on ? KEYENCE_PROGRAM_LASER_ON : KEYENCE_PROGRAM_LASER_OFF;
+
   if (!keyence_client_.call(keyence_srv))
   {
-    ROS_ERROR_STREAM("Unable to de-activate keyence (program " << KEYENCE_PROGRAM_LASER_OFF
-                                                              << ").");
+    ROS_ERROR_STREAM("Unable to " << (on ? "activate" : "de-activate") << " keyence (program "
+                                  << keyence_srv.request.program_no << ").");
     return false;
   }
+  return true;
+}
+
+bool godel_process_execution::KeyenceProcessService::executeTrajectory(
+    const trajectory_msgs::JointTrajectory& traj, const std::string& description)
+{
+  godel_msgs::TrajectoryExecution srv;
+  srv.request.wait_for_execution = true;
+  srv.request.trajectory = traj;
 
-  if (!real_client_.call(srv_depart))
+  if (!real_client_.call(srv))
   {
-    ROS_ERROR("Execution client unavailable or unable to execute departure trajectory.");
+    ROS_ERROR_STREAM("Execution client unavailable or unable to execute " << description << " trajectory.");
     return false;
   }
 
@@ -1,5 +1,7 @@
 #include "process_utils.h"
 
+#include <cmath>
+
 void godel_process_execution::appendTrajectory(trajectory_msgs::JointTrajectory& original,
                                                const trajectory_msgs::JointTrajectory& next)
 {
@@ -12,4 +14,52 @@ void godel_process_execution::appendTrajectory(trajectory_msgs::JointTrajectory&
 
     original.points.push_back(pt);
   }
-}
\ No newline at end of file
+}
+
+std::size_t godel_process_execution::joinTrajectory(trajectory_msgs::JointTrajectory& original,
+                                                    const trajectory_msgs::JointTrajectory& next)
+{
+  const double REPEAT_TOLERANCE = 1e-6; // radians
+
+  bool repeated = !original.points.empty() && !next.points.empty() &&
+                  original.points.back().positions.size() == next.points.front().positions.size();
+  for (std::size_t j = 0; repeated && j < next.points.front().positions.size(); ++j)
+  {
+    repeated = std::abs(original.points.back().positions[j] - next.points.front().positions[j]) < REPEAT_TOLERANCE;
+  }
+
+  if (!repeated)
+  {
+    const std::size_t first = original.points.size();
+    appendTrajectory(original, next);
+    return first;
+  }
+
+  const std::size_t first = original.points.size() - 1;
+  const ros::Duration last_t = original.points.back().time_from_start - next.points.front().time_from_start;
+  for (std::size_t i = 1; i < next.points.size(); ++i)
+  {
+    trajectory_msgs::JointTrajectoryPoint pt = next.points[i];
+    pt.time_from_start += last_t;
+    original.points.push_back(pt);
+  }
+  return first;
+}
+
+trajectory_msgs::JointTrajectory
+godel_process_execution::extractTrajectory(const trajectory_msgs::JointTrajectory& traj,
+                                           std::size_t first, std::size_t last)
+{
+  trajectory_msgs::JointTrajectory result;
+  result.header = traj.header;
+  result.joint_names = traj.joint_names;
+
+  const ros::Duration t0 = traj.points[first].time_from_start;
+  for (std::size_t i = first; i <= last && i < traj.points.size(); ++i)
+  {
+    trajectory_msgs::JointTrajectoryPoint pt = traj.points[i];
+    pt.time_from_start -= t0;
+    result.points.push_back(pt);
+  }
+  return result;
+}
@@ -8,6 +8,15 @@ namespace godel_process_execution
 
 void appendTrajectory(trajectory_msgs::JointTrajectory& original,
                       const trajectory_msgs::JointTrajectory& next);
+
+// like appendTrajectory, but drops the first point of 'next' if it repeats the last point of 'original'.
+// Returns the index in 'original' that the first point of 'next' ended up at.
+std::size_t joinTrajectory(trajectory_msgs::JointTrajectory& original,
+                           const trajectory_msgs::JointTrajectory& next);
+
+// points first through last of 'traj', timed from the first of them
+trajectory_msgs::JointTrajectory extractTrajectory(const trajectory_msgs::JointTrajectory& traj,
+                                                   std::size_t first, std::size_t last);
 }
 
 #endif
@@ -119,6 +119,17 @@ inline void filter(PolygonBoundaryCollection& boundaries, double tol)
   }
 }
 
+/**@brief Downsample a closed boundary by chordal deviation
+ * A vertex is removed when every vertex it is merged into a chord with lies within chordal_tol of
+ * that chord, so points are kept where the boundary curves and dropped along straight runs. The
+ * first vertex is always kept.
+ * @param boundary PolygonBoundary to modify
+ * @param chordal_tol (m) maximum distance of a removed vertex from the chord replacing it; 0 keeps
+ * every vertex
+ * @param max_spacing (m) chords are never made longer than this; 0 for no limit
+ */
+void simplify(PolygonBoundary& boundary, double chordal_tol, double max_spacing = 0.);
+
 /**@brief Check if a intersects b */
 bool intersects(const PolygonBoundary& a, const PolygonBoundary& b);
 
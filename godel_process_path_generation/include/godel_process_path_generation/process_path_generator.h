@@ -47,7 +47,8 @@ class ProcessPathGenerator
 {
 public:
   ProcessPathGenerator()
-      : tool_radius_(0.), margin_(0.), overlap_(0.), safe_traverse_height_(-1.), verbose_(false){};
+      : tool_radius_(0.), margin_(0.), overlap_(0.), safe_traverse_height_(-1.),
+        chordal_tolerance_(0.), verbose_(false){};
   virtual ~ProcessPathGenerator(){};
 
   bool createProcessPath();
@@ -72,6 +73,7 @@ public:
   }
 
   void setDiscretizationDistance(double d) { max_discretization_distance_ = std::abs(d); }
+  void setChordalTolerance(double tol) { chordal_tolerance_ = std::abs(tol); }
   void setMargin(double margin) { margin_ = margin; }
   void setOverlap(double overlap) { overlap_ = overlap; }
   void setToolRadius(double radius) { tool_radius_ = std::abs(radius); }
@@ -120,6 +122,8 @@ private:
   double
       max_discretization_distance_; /**<(m) When discretizing segments, use this or less distance
                                        between points */
+  double chordal_tolerance_; /**<(m) Polygon vertices closer than this to the chord between their
+                                neighbors are dropped. 0 keeps every vertex. */
 
   PolygonBoundaryCollection* path_polygons_;
   const std::vector<double>* path_offsets_;
@@ -128,6 +128,60 @@ void filter(PolygonBoundary& boundary, double tol)
   }
 }
 
+void simplify(PolygonBoundary& boundary, double chordal_tol, double max_spacing)
+{
+  if (boundary.size() < 3 || chordal_tol <= 0.)
+  {
+    return;
+  }
+
+  // Walk the closed loop, growing each chord from the last kept vertex until one of the vertices it
+  // would replace strays too far from it.
+  PolygonBoundary closed = boundary;
+  closed.push_back(closed.front());
+
+  PolygonBoundary result;
+  size_t anchor = 0;
+  result.push_back(closed[anchor]);
+  while (anchor < closed.size() - 1)
+  {
+    size_t end = anchor + 1;
+    while (end + 1 < closed.size())
+    {
+      const size_t candidate = end + 1;
+      if (max_spacing > 0. && closed[anchor].dist(closed[candidate]) > max_spacing)
+      {
+        break;
+      }
+
+      const PolygonPt chord = closed[candidate] - closed[anchor];
+      const double chord_len = chord.norm();
+      bool within_tol = true;
+      for (size_t ii = anchor + 1; ii < candidate && within_tol; ++ii)
+      {
+        const PolygonPt rel = closed[ii] - closed[anchor];
+        const double t = chord_len > 0. ? rel.dot(chord) / (chord_len * chord_len) : 0.;
+        const double dev = (t <= 0.) ? rel.norm() : (t >= 1.) ? closed[ii].dist(closed[candidate])
+                                                              : std::abs(rel.cross(chord)) / chord_len;
+        within_tol = dev <= chordal_tol;
+      }
+      if (!within_tol)
+      {
+        break;
+      }
+      end = candidate;
+    }
+
+    anchor = end;
+    if (anchor < closed.size() - 1)
+    {
+      result.push_back(closed[anchor]);
+    }
+  }
+
+  boundary.swap(result);
+}
+
 bool intersects(const PolygonBoundary& a, const PolygonBoundary& b)
 {
   std::vector<PolygonSegment> v_a, v_b;
@@ -64,6 +64,7 @@ void ProcessPathGenerator::addInterpolatedProcessPts(const ProcessPt& start, con
 void ProcessPathGenerator::addPolygonToProcessPath(const PolygonBoundary& bnd_ref)
 {
   PolygonBoundary bnd = bnd_ref;
+  polygon_utils::simplify(bnd, chordal_tolerance_, max_discretization_distance_);
   bnd.push_back(bnd.front());
   ProcessPt process_pt;
   BOOST_FOREACH (const PolygonPt& pg_pt, bnd)
@@ -37,6 +37,8 @@
 const std::string OFFSET_POLYGON_SERVICE = "offset_polygon";
 
 const static double DISCRETIZATION_DISTANCE = 0.01; // m
+const static double MAX_DISCRETIZATION_DISTANCE = 0.05; // m, longest step along straight runs
+const static double CHORDAL_TOLERANCE = 0.0005;      // m
 const static double TRAVERSE_HEIGHT = 0.075;        // m
 
 double dist(const Eigen::Affine3d& from, const Eigen::Affine3d& to)
@@ -77,7 +79,8 @@ bool generateProcessPlan(descartes::ProcessPath& process_path,
   // Create ProcessPathGenerator and initialize.
   godel_process_path::ProcessPathGenerator ppg;
   ppg.verbose_ = true;
-  ppg.setDiscretizationDistance(DISCRETIZATION_DISTANCE);
+  ppg.setDiscretizationDistance(MAX_DISCRETIZATION_DISTANCE);
+  ppg.setChordalTolerance(CHORDAL_TOLERANCE);
   ppg.setMargin(req.params.margin);
   ppg.setOverlap(req.params.overlap);
   ppg.setToolRadius(req.params.tool_radius);
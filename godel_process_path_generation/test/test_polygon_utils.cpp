@@ -64,6 +64,44 @@ TEST(PolygonSegment, complex)
   EXPECT_TRUE(s41.intersects(s23));
 }
 
+TEST(PolygonUtils, simplify)
+{
+  using godel_process_path::PolygonPt;
+
+  // Square with 1cm discretized edges and a slightly bowed top edge
+  godel_process_path::PolygonBoundary boundary;
+  for (int ii = 0; ii < 10; ++ii)
+    boundary.push_back(PolygonPt(.01 * ii, 0.));
+  for (int ii = 0; ii < 10; ++ii)
+    boundary.push_back(PolygonPt(.1, .01 * ii));
+  for (int ii = 0; ii < 10; ++ii)
+    boundary.push_back(PolygonPt(.1 - .01 * ii, .1 + (ii == 5 ? .0002 : 0.)));
+  for (int ii = 0; ii < 10; ++ii)
+    boundary.push_back(PolygonPt(0., .1 - .01 * ii));
+
+  godel_process_path::PolygonBoundary corners = boundary;
+  godel_process_path::polygon_utils::simplify(corners, .001);
+  ASSERT_EQ(4u, corners.size());
+  EXPECT_EQ(PolygonPt(0., 0.), corners[0]);
+  EXPECT_EQ(PolygonPt(.1, 0.), corners[1]);
+  EXPECT_EQ(PolygonPt(.1, .1), corners[2]);
+  EXPECT_EQ(PolygonPt(0., .1), corners[3]);
+
+  // Bow is kept when tolerance is tighter than it
+  godel_process_path::PolygonBoundary bowed = boundary;
+  godel_process_path::polygon_utils::simplify(bowed, .0001);
+  EXPECT_GT(bowed.size(), corners.size());
+
+  // Spacing limit splits the straight runs
+  godel_process_path::PolygonBoundary spaced = boundary;
+  godel_process_path::polygon_utils::simplify(spaced, .001, .055);
+  EXPECT_EQ(8u, spaced.size());
+  for (size_t ii = 0; ii < spaced.size(); ++ii)
+  {
+    EXPECT_LE(spaced[ii].dist(spaced[(ii + 1) % spaced.size()]), .055);
+  }
+}
+
 int main(int argc, char** argv)
 {
   testing::InitGoogleTest(&argc, argv);
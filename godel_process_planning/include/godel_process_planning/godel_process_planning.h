@@ -5,7 +5,12 @@
 #include "godel_msgs/KeyenceProcessPlanning.h"
 
 #include <descartes_core/robot_model.h>
+#include <godel_utils/joint_state_cache.h>
+#include <moveit_msgs/CollisionObject.h>
+#include <ros/ros.h>
 #include <pluginlib/class_loader.h>
+#include <map>
+#include <memory>
 
 /*
  * This class wraps Descartes planning methods and provides functionality for configuration
@@ -24,6 +29,10 @@
 namespace godel_process_planning
 {
 
+struct PreviousSolution;
+class FreeSpaceRoadmap;
+class PartHeightMap;
+
 class ProcessPlanningManager
 {
 public:
@@ -38,6 +47,11 @@ public:
                              godel_msgs::KeyenceProcessPlanning::Response& res);
 
 private:
+  void partCollisionObjectCallback(const moveit_msgs::CollisionObjectConstPtr& object);
+
+  // Drops the previous solutions of all paths if they were planned for another surface detection
+  void checkDetection(unsigned detection_id);
+
   descartes_core::RobotModelPtr blend_model_;
   descartes_core::RobotModelPtr keyence_model_;
   moveit::core::RobotModelConstPtr moveit_model_;
@@ -45,6 +59,19 @@ private:
       plugin_loader_; // kept around so code doesn't get unloaded
   std::string blend_group_name_;
   std::string keyence_group_name_;
+  // Latest robot state, kept by one subscription for the lifetime of the manager
+  std::unique_ptr<godel_utils::JointStateCache> joint_states_;
+  // Last solution of each named blend/scan path, used to warm-start replanning it
+  std::map<std::string, std::shared_ptr<PreviousSolution>> previous_blend_solutions_;
+  std::map<std::string, std::shared_ptr<PreviousSolution>> previous_scan_solutions_;
+  unsigned detection_id_ = 0; // surface detection the previous solutions belong to
+  // Free space paths found so far for each robot model, reused for approach and depart moves
+  std::shared_ptr<FreeSpaceRoadmap> blend_roadmap_;
+  std::shared_ptr<FreeSpaceRoadmap> keyence_roadmap_;
+  // Scanned part geometry, published to the planning scene by the surface detection
+  ros::Subscriber part_object_sub_;
+  std::shared_ptr<PartHeightMap> part_map_;
+  double part_clearance_; // (m) transitions hop this far over the part; must cover the tool
 };
 }
 
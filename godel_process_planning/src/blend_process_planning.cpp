@@ -19,9 +19,6 @@ namespace godel_process_planning
 const double BLENDING_ANGLE_DISCRETIZATION =
     M_PI / 12.0; // The discretization of the tool's pose about
                  // the z axis
-const static std::string JOINT_TOPIC_NAME =
-    "joint_states"; // ROS topic to subscribe to for current robot
-                    // state info
 /**
  * @brief Translated an Eigen pose to a Descartes trajectory point appropriate for the BLEND
  * process!
@@ -52,6 +49,7 @@ bool ProcessPlanningManager::handleBlendPlanning(godel_msgs::BlendProcessPlannin
 {
   // Enable Collision Checks
   blend_model_->setCheckCollisions(true);
+  checkDetection(req.detection_id);
 
   // Precondition: There must be at least one input segments
   if (req.path.segments.empty())
@@ -60,35 +58,80 @@ bool ProcessPlanningManager::handleBlendPlanning(godel_msgs::BlendProcessPlannin
     return true;
   }
 
+  // Precondition: Points are timed by the traverse speed, which must be positive
+  if (req.params.traverse_spd <= 0.0)
+  {
+    ROS_ERROR("Planning request has a traverse speed of %f m/s. Speeds must be positive.", req.params.traverse_spd);
+    return false;
+  }
+
+  // Precondition: Chained paths are either all named or all unnamed
+  if (!req.chained_names.empty() && req.chained_names.size() != req.chained_paths.size())
+  {
+    ROS_ERROR("Planning request named %lu of %lu chained paths. Invalid input.", req.chained_names.size(),
+              req.chained_paths.size());
+    return false;
+  }
+
+  std::vector<godel_msgs::ProcessPath> paths (1, req.path);
+  paths.insert(paths.end(), req.chained_paths.begin(), req.chained_paths.end());
+
   // Precondition: All input segments must have at least one pose associated with them
-  for (const auto& segment : req.path.segments)
+  for (const auto& path : paths)
   {
-    if (segment.poses.empty())
+    if (path.segments.empty())
     {
-      ROS_ERROR("Input trajectory segment contained no poses. Invalid input.");
+      ROS_ERROR("Chained path contained no trajectory segments. Invalid input.");
       return false;
     }
+
+    for (const auto& segment : path.segments)
+    {
+      if (segment.poses.empty())
+      {
+        ROS_ERROR("Input trajectory segment contained no poses. Invalid input.");
+        return false;
+      }
+    }
   }
 
   // Transform process path from geometry msgs to descartes points
-  std::vector<double> current_joints = getCurrentJointState(JOINT_TOPIC_NAME);
+  std::vector<double> current_joints =
+      req.start_state.empty() ? getCurrentJointState(*joint_states_) : req.start_state;
 
   const static double LINEAR_DISCRETIZATION = 0.01; // meters
   const static double ANGULAR_DISCRETIZATION = 0.1; // radians
+  const static double CHORDAL_TOLERANCE = 0.0005; // meters
+  const static double ANGULAR_TOLERANCE = 0.02; // radians
+  const static double MAX_LINEAR_DISCRETIZATION = 0.05; // meters
   const static double RETRACT_DISTANCE = 0.05; // meters
 
   TransitionParameters transition_params;
   transition_params.linear_disc = LINEAR_DISCRETIZATION;
   transition_params.angular_disc = ANGULAR_DISCRETIZATION;
+  transition_params.chordal_tol = CHORDAL_TOLERANCE;
+  transition_params.angular_tol = ANGULAR_TOLERANCE;
+  transition_params.max_disc = MAX_LINEAR_DISCRETIZATION;
   transition_params.retract_dist = RETRACT_DISTANCE;
   transition_params.traverse_height = req.params.safe_traverse_height;
   transition_params.z_adjust = req.params.z_adjust;
+  transition_params.traverse_speed = req.params.traverse_spd;
+  transition_params.part = part_map_.get();
+  transition_params.part_clearance = part_clearance_;
 
-  DescartesTraj process_points = toDescartesTraj(req.path.segments, req.params.traverse_spd, transition_params,
-                                                 toDescartesBlendPt);
+  std::vector<DescartesTraj> process_points;
+  std::vector<PreviousSolution*> previous;
+  for (std::size_t k = 0; k < paths.size(); ++k)
+  {
+    process_points.push_back(toDescartesTraj(paths[k].segments, req.params.traverse_spd, transition_params,
+                                             toDescartesBlendPt));
+    const std::string name = k == 0 ? req.name : (req.chained_names.empty() ? "" : req.chained_names[k - 1]);
+    previous.push_back(findPreviousSolution(previous_blend_solutions_, name));
+  }
 
-  if (generateMotionPlan(blend_model_, process_points, moveit_model_, blend_group_name_,
-                         current_joints, res.plan))
+  if (generateJobPlan(blend_model_, process_points, moveit_model_, blend_group_name_,
+                      current_joints, res.plan, req.params.sparse_planning, previous,
+                      blend_roadmap_.get()))
   {
     res.plan.type = res.plan.BLEND_TYPE;
     return true;
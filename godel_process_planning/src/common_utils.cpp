@@ -7,8 +7,8 @@
 #include <moveit/kinematic_constraints/utils.h>
 #include <moveit_msgs/GetMotionPlan.h>
 
-#include <ros/topic.h>
 #include "trajectory_utils.h"
+#include "free_space_roadmap.h"
 
 // Constants
 const static double DEFAULT_TIME_UNDEFINED_VELOCITY =
@@ -20,8 +20,8 @@ const static std::string DEFAULT_FRAME_ID =
 const static double DEFAULT_ANGLE_DISCRETIZATION =
     M_PI / 12.0; // Default discretization used for axially-symmetric points
                  // in these helper functions
-const static double DEFAULT_JOINT_WAIT_TIME = 5.0; // Maximum time allowed to capture a new joint
-                                                   // state message
+const static double DEFAULT_JOINT_WAIT_TIME = 5.0; // Maximum time allowed for the first joint state
+                                                   // message to arrive
 const static double DEFAULT_JOINT_VELOCITY = 0.3; // rad/s
 
 // MoveIt Configuration Constants
@@ -74,10 +74,19 @@ Eigen::Affine3d godel_process_planning::createNominalTransform(const Eigen::Affi
 
 bool godel_process_planning::descartesSolve(const godel_process_planning::DescartesTraj& in_path,
                                             descartes_core::RobotModelConstPtr robot_model,
-                                            godel_process_planning::DescartesTraj& out_path)
+                                            godel_process_planning::DescartesTraj& out_path,
+                                            bool sparse)
 {
   // Create planner
-  descartes_core::PathPlannerBasePtr planner(new descartes_planner::DensePlanner);
+  descartes_core::PathPlannerBasePtr planner;
+  if (sparse)
+  {
+    planner.reset(new descartes_planner::SparsePlanner);
+  }
+  else
+  {
+    planner.reset(new descartes_planner::DensePlanner);
+  }
   if (!planner->initialize(robot_model))
   {
     ROS_ERROR("%s: Failed to initialize planner with robot model", __FUNCTION__);
@@ -168,10 +177,10 @@ void godel_process_planning::fillTrajectoryHeaders(const std::vector<std::string
   traj.header.stamp = ros::Time::now();
 }
 
-std::vector<double> godel_process_planning::getCurrentJointState(const std::string& topic)
+std::vector<double>
+godel_process_planning::getCurrentJointState(const godel_utils::JointStateCache& joint_states)
 {
-  sensor_msgs::JointStateConstPtr state = ros::topic::waitForMessage<sensor_msgs::JointState>(
-      topic, ros::Duration(DEFAULT_JOINT_WAIT_TIME));
+  sensor_msgs::JointStateConstPtr state = joint_states.waitForState(ros::WallDuration(DEFAULT_JOINT_WAIT_TIME));
   if (!state)
     throw std::runtime_error("Joint state message capture failed");
   return state->position;
@@ -263,7 +272,7 @@ trajectory_msgs::JointTrajectory godel_process_planning::getMoveitPlan(
 trajectory_msgs::JointTrajectory godel_process_planning::planFreeMove(
     descartes_core::RobotModel& model, const std::string& group_name,
     moveit::core::RobotModelConstPtr moveit_model, const std::vector<double>& start,
-    const std::vector<double>& stop)
+    const std::vector<double>& stop, FreeSpaceRoadmap* roadmap)
 {
   // Attempt joint interpolated motion
   DescartesTraj joint_approach = createJointPath(start, stop);
@@ -280,15 +289,36 @@ trajectory_msgs::JointTrajectory godel_process_planning::planFreeMove(
   }
 
   // If the method is collision free, then we use the interpolation
-  // otherwise let moveit try
+  // otherwise try the roadmap of past free space paths and then let moveit try
   if (collision_free)
   {
     return toROSTrajectory(joint_approach, model);
   }
-  else
+
+  JointVector waypoints;
+  if (roadmap && roadmap->findPath(model, start, stop, waypoints))
   {
-    return godel_process_planning::getMoveitPlan(group_name, start, stop, moveit_model);
+    DescartesTraj roadmap_path;
+    for (std::size_t i = 1; i < waypoints.size(); ++i)
+    {
+      DescartesTraj leg = createJointPath(waypoints[i - 1], waypoints[i]);
+      roadmap_path.insert(roadmap_path.end(), roadmap_path.empty() ? leg.begin() : leg.begin() + 1, leg.end());
+    }
+    return toROSTrajectory(roadmap_path, model);
+  }
+
+  trajectory_msgs::JointTrajectory plan = godel_process_planning::getMoveitPlan(group_name, start, stop,
+                                                                                moveit_model);
+  if (roadmap)
+  {
+    waypoints.clear();
+    for (const auto& pt : plan.points)
+    {
+      waypoints.push_back(pt.positions);
+    }
+    roadmap->addPath(model, waypoints);
   }
+  return plan;
 }
 
 std::vector<std::vector<double>>
@@ -8,6 +8,7 @@
 #include <descartes_core/robot_model.h>
 
 #include <sensor_msgs/JointState.h>
+#include <godel_utils/joint_state_cache.h>
 
 #include <Eigen/Geometry>
 
@@ -15,6 +16,8 @@ namespace godel_process_planning
 {
 typedef std::vector<descartes_core::TrajectoryPtPtr> DescartesTraj;
 
+class FreeSpaceRoadmap;
+
 /**
    * @brief Converts a point relative to given pose into a robot tool pose (i.e. flip z)
    * @param ref_pose Reference pose (in world frame) for 'pt'
@@ -41,10 +44,12 @@ Eigen::Affine3d createNominalTransform(const Eigen::Affine3d& ref_pose, const do
  * @param in_path Trajectory to solve
  * @param robot_model Robot model used for IK/FK by planner
  * @param out_path The solution path, if found, otherwise undefined
+ * @param sparse Use the Descartes sparse planner, which searches a subsample of the path, instead of
+ * the dense planner
  * @return True if path was found and result placed inside 'out_path'; False otherwise.
  */
 bool descartesSolve(const DescartesTraj& in_path, descartes_core::RobotModelConstPtr robot_model,
-                    DescartesTraj& out_path);
+                    DescartesTraj& out_path, bool sparse = false);
 /**
  * @brief Extracts joint position values from Descartes trajectory and packs them into a ROS message
  * @param solution The Descartes trajectory used to generate nominal joint trajectory
@@ -63,11 +68,12 @@ void fillTrajectoryHeaders(const std::vector<std::string>& joints,
                            trajectory_msgs::JointTrajectory& traj);
 
 /**
- * @brief Attempts to capture the most recent JointState from the given topic
- * @param topic The joint topic name on which to listen for the robot state
- * @return The joint positions captured from the topic or a std::runtime_error
+ * @brief Returns the most recent JointState held by \e joint_states, waiting briefly if none has
+ * arrived yet
+ * @param joint_states Cache of the joint topic on which the robot state is published
+ * @return The joint positions of the latest state or a std::runtime_error
  */
-std::vector<double> getCurrentJointState(const std::string& topic);
+std::vector<double> getCurrentJointState(const godel_utils::JointStateCache& joint_states);
 
 /**
  * @brief Creates descartes trajectory consisting of cartesian positions in a linear path between
@@ -120,19 +126,22 @@ static inline std::vector<double> extractJoints(const descartes_core::RobotModel
 /**
  * @brief A planning helper function for getting a valid path between start and stop; first attempts
  * a joint interpolated motion
- *        to see if its collision free. If not, it invokes MoveIt as a backup.
+ *        to see if its collision free. If not, it searches \e roadmap and only then invokes MoveIt
+ *        as a backup. MoveIt solutions are added to \e roadmap.
  * @param model Associated descartes robot model
  * @param group_name Name of moveit move-group associated with the moveit model
  * @param moveit_model the moveit robot description associated with this item
  * @param start Initial robot configuration
  * @param stop Final robot configuration
+ * @param roadmap Optional roadmap of past free space paths for this robot model
  * @return A collision-free path from start to stop
  */
 trajectory_msgs::JointTrajectory planFreeMove(descartes_core::RobotModel& model,
                                               const std::string& group_name,
                                               moveit::core::RobotModelConstPtr moveit_model,
                                               const std::vector<double>& start,
-                                              const std::vector<double>& stop);
+                                              const std::vector<double>& stop,
+                                              FreeSpaceRoadmap* roadmap = nullptr);
 
 /**
  * @brief Given a list of possible joint solutions, remove those that end in collision. Checking via 'model'.
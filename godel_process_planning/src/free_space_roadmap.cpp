@@ -0,0 +1,269 @@
+#include "free_space_roadmap.h"
+#include "common_utils.h"
+
+#include <ros/console.h>
+#include <algorithm>
+#include <limits>
+#include <queue>
+
+// Roadmap Constants
+const static std::size_t MAX_MILESTONES = 1000;
+const static std::size_t NEIGHBORS = 10;            // Milestones a new one attempts to connect to
+const static double CONNECTION_RADIUS = 2.0;        // Largest free space cost of an edge
+const static double MILESTONE_SPACING = 0.5;        // Free space cost along a path before a waypoint is kept
+const static double MILESTONE_MERGE_COST = 1e-3;    // Configurations closer than this share a milestone
+const static double COLLISION_CHECK_STEP = 0.05;    // (rad) Joint step when checking an edge
+const static int MAX_SEARCH_ATTEMPTS = 5;           // Searches before giving up on blocked edges
+
+bool godel_process_planning::isJointMotionValid(const descartes_core::RobotModel& model,
+                                                const std::vector<double>& from,
+                                                const std::vector<double>& to)
+{
+  const JointVector steps = interpolateJoint(from, to, COLLISION_CHECK_STEP);
+  for (const auto& joints : steps)
+  {
+    if (!model.isValid(joints))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool godel_process_planning::FreeSpaceRoadmap::findPath(descartes_core::RobotModel& model,
+                                                        const std::vector<double>& start,
+                                                        const std::vector<double>& stop, JointVector& path)
+{
+  if (milestones_.empty())
+  {
+    return false;
+  }
+
+  const std::vector<Edge> entries = reachable(model, start);
+  const std::vector<Edge> exits = reachable(model, stop);
+  if (entries.empty() || exits.empty())
+  {
+    return false;
+  }
+
+  for (int attempt = 0; attempt < MAX_SEARCH_ATTEMPTS; ++attempt)
+  {
+    // Dijkstra from all entry milestones at once, seeded with the cost of reaching them
+    const double inf = std::numeric_limits<double>::max();
+    std::vector<double> cost (milestones_.size(), inf);
+    std::vector<std::size_t> parent (milestones_.size(), milestones_.size());
+    typedef std::pair<double, std::size_t> QueueItem;
+    std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> queue;
+
+    for (const auto& e : entries)
+    {
+      cost[e.first] = e.second;
+      queue.push(QueueItem(e.second, e.first));
+    }
+
+    while (!queue.empty())
+    {
+      const QueueItem top = queue.top();
+      queue.pop();
+      if (top.first > cost[top.second])
+      {
+        continue;
+      }
+      for (const auto& e : edges_[top.second])
+      {
+        const double c = top.first + e.second;
+        if (c < cost[e.first])
+        {
+          cost[e.first] = c;
+          parent[e.first] = top.second;
+          queue.push(QueueItem(c, e.first));
+        }
+      }
+    }
+
+    // Cheapest way out
+    std::size_t exit = milestones_.size();
+    double best = inf;
+    for (const auto& e : exits)
+    {
+      if (cost[e.first] != inf && cost[e.first] + e.second < best)
+      {
+        best = cost[e.first] + e.second;
+        exit = e.first;
+      }
+    }
+    if (exit == milestones_.size())
+    {
+      return false;
+    }
+
+    std::vector<std::size_t> route;
+    for (std::size_t m = exit; m != milestones_.size(); m = parent[m])
+    {
+      route.push_back(m);
+    }
+    std::reverse(route.begin(), route.end());
+
+    // The environment may have changed since the edges were added
+    bool blocked = false;
+    for (std::size_t i = 1; i < route.size(); ++i)
+    {
+      if (!isJointMotionValid(model, milestones_[route[i - 1]], milestones_[route[i]]))
+      {
+        disconnect(route[i - 1], route[i]);
+        blocked = true;
+      }
+    }
+    if (blocked)
+    {
+      continue;
+    }
+
+    path.clear();
+    path.push_back(start);
+    for (const auto m : route)
+    {
+      path.push_back(milestones_[m]);
+    }
+    path.push_back(stop);
+    return true;
+  }
+
+  return false;
+}
+
+void godel_process_planning::FreeSpaceRoadmap::addPath(descartes_core::RobotModel& model, const JointVector& path)
+{
+  if (path.empty())
+  {
+    return;
+  }
+
+  std::size_t prev;
+  if (!addMilestone(model, path.front(), prev))
+  {
+    return;
+  }
+
+  std::size_t prev_waypoint = 0;
+  for (std::size_t j = 1; j < path.size(); ++j)
+  {
+    // Skip waypoints as long as the next one can still be reached directly from the last milestone
+    if (j + 1 < path.size() && freeSpaceCostFunction(path[prev_waypoint], path[j + 1]) < MILESTONE_SPACING &&
+        isJointMotionValid(model, milestones_[prev], path[j + 1]))
+    {
+      continue;
+    }
+
+    std::size_t m;
+    if (!addMilestone(model, path[j], m))
+    {
+      return;
+    }
+    if (m != prev && isJointMotionValid(model, milestones_[prev], milestones_[m]))
+    {
+      connect(prev, m);
+    }
+    prev = m;
+    prev_waypoint = j;
+  }
+
+  ROS_DEBUG("%s: Free space roadmap has %lu milestones", __FUNCTION__, milestones_.size());
+}
+
+bool godel_process_planning::FreeSpaceRoadmap::addMilestone(descartes_core::RobotModel& model,
+                                                            const std::vector<double>& joints,
+                                                            std::size_t& index)
+{
+  const auto closest = nearest(joints, 1, MILESTONE_MERGE_COST);
+  if (!closest.empty())
+  {
+    index = closest.front();
+    return true;
+  }
+
+  if (milestones_.size() >= MAX_MILESTONES || !model.isValid(joints))
+  {
+    return false;
+  }
+
+  const auto neighbors = nearest(joints, NEIGHBORS, CONNECTION_RADIUS);
+
+  index = milestones_.size();
+  milestones_.push_back(joints);
+  edges_.push_back(std::vector<Edge>());
+
+  for (const auto n : neighbors)
+  {
+    if (isJointMotionValid(model, milestones_[n], joints))
+    {
+      connect(n, index);
+    }
+  }
+  return true;
+}
+
+void godel_process_planning::FreeSpaceRoadmap::connect(std::size_t a, std::size_t b)
+{
+  for (const auto& e : edges_[a])
+  {
+    if (e.first == b)
+    {
+      return;
+    }
+  }
+
+  const double cost = freeSpaceCostFunction(milestones_[a], milestones_[b]);
+  edges_[a].push_back(Edge(b, cost));
+  edges_[b].push_back(Edge(a, cost));
+}
+
+void godel_process_planning::FreeSpaceRoadmap::disconnect(std::size_t a, std::size_t b)
+{
+  auto remove = [](std::vector<Edge>& edges, std::size_t target) {
+    edges.erase(std::remove_if(edges.begin(), edges.end(), [target](const Edge& e) { return e.first == target; }),
+                edges.end());
+  };
+  remove(edges_[a], b);
+  remove(edges_[b], a);
+}
+
+std::vector<std::size_t>
+godel_process_planning::FreeSpaceRoadmap::nearest(const std::vector<double>& joints, std::size_t k,
+                                                  double radius) const
+{
+  std::vector<std::pair<double, std::size_t>> candidates;
+  for (std::size_t i = 0; i < milestones_.size(); ++i)
+  {
+    const double cost = freeSpaceCostFunction(joints, milestones_[i]);
+    if (cost <= radius)
+    {
+      candidates.push_back(std::make_pair(cost, i));
+    }
+  }
+
+  const std::size_t n = std::min(k, candidates.size());
+  std::partial_sort(candidates.begin(), candidates.begin() + n, candidates.end());
+
+  std::vector<std::size_t> result;
+  for (std::size_t i = 0; i < n; ++i)
+  {
+    result.push_back(candidates[i].second);
+  }
+  return result;
+}
+
+std::vector<godel_process_planning::FreeSpaceRoadmap::Edge>
+godel_process_planning::FreeSpaceRoadmap::reachable(descartes_core::RobotModel& model,
+                                                    const std::vector<double>& joints) const
+{
+  std::vector<Edge> result;
+  for (const auto n : nearest(joints, NEIGHBORS, CONNECTION_RADIUS))
+  {
+    if (isJointMotionValid(model, joints, milestones_[n]))
+    {
+      result.push_back(Edge(n, freeSpaceCostFunction(joints, milestones_[n])));
+    }
+  }
+  return result;
+}
@@ -0,0 +1,68 @@
+#ifndef GODEL_PROCESS_PLANNING_FREE_SPACE_ROADMAP_H
+#define GODEL_PROCESS_PLANNING_FREE_SPACE_ROADMAP_H
+
+#include <descartes_core/robot_model.h>
+#include "trajectory_utils.h"
+
+namespace godel_process_planning
+{
+
+/**
+ * @brief A joint space roadmap of collision checked milestones, grown from the free space paths that
+ * had to be planned by MoveIt. Later free space queries between nearby configurations are answered by
+ * searching this graph, which is much cheaper than sampling based planning.
+ *
+ * Edges are joint interpolated motions. They are checked when added and checked again before a path
+ * using them is returned, so milestones that a changed environment blocks are dropped lazily.
+ */
+class FreeSpaceRoadmap
+{
+public:
+  /**
+   * @brief Attempts to find a collision free path from \e start to \e stop through the roadmap
+   * @param model Descartes robot model used for collision checking
+   * @param path Output parameter - joint waypoints from \e start to \e stop, both included. Moving
+   * between consecutive waypoints by joint interpolation is collision free.
+   * @return True if a path was found
+   */
+  bool findPath(descartes_core::RobotModel& model, const std::vector<double>& start,
+                const std::vector<double>& stop, JointVector& path);
+
+  /**
+   * @brief Adds the waypoints of a collision free path (e.g. a MoveIt solution) as milestones. Waypoints
+   * are thinned out to the ones needed to keep joint interpolation between them collision free.
+   */
+  void addPath(descartes_core::RobotModel& model, const JointVector& path);
+
+  std::size_t size() const { return milestones_.size(); }
+
+private:
+  typedef std::pair<std::size_t, double> Edge; // (target milestone, cost)
+
+  // Index of the milestone for 'joints', which may be an existing one close to it; false if the roadmap is full
+  // or 'joints' is in collision
+  bool addMilestone(descartes_core::RobotModel& model, const std::vector<double>& joints, std::size_t& index);
+
+  void connect(std::size_t a, std::size_t b);
+
+  void disconnect(std::size_t a, std::size_t b);
+
+  // Milestones ordered by increasing cost from 'joints', at most 'k' and no farther than 'radius'
+  std::vector<std::size_t> nearest(const std::vector<double>& joints, std::size_t k, double radius) const;
+
+  // Milestones reachable from 'joints' by a collision free joint interpolated motion, with their cost
+  std::vector<Edge> reachable(descartes_core::RobotModel& model, const std::vector<double>& joints) const;
+
+  JointVector milestones_;
+  std::vector<std::vector<Edge>> edges_;
+};
+
+/**
+ * @brief True if the joint interpolated motion from \e from to \e to is collision free
+ */
+bool isJointMotionValid(const descartes_core::RobotModel& model, const std::vector<double>& from,
+                        const std::vector<double>& to);
+
+}
+
+#endif // GODEL_PROCESS_PLANNING_FREE_SPACE_ROADMAP_H
@@ -6,6 +6,47 @@
 
 #include <descartes_planner/ladder_graph_dag_search.h>
 #include <descartes_planner/dense_planner.h>
+#include <descartes_planner/sparse_planner.h>
+
+// Sparse planning constants
+const static double SPARSE_SAMPLING = 0.1; // Fraction of the process points the sparse planner solves directly
+const static std::size_t LOCAL_REPLAN_MARGIN = 10; // Points added on each side of a failed transition before it is
+                                                   // replanned densely
+const static int LOCAL_REPLAN_ATTEMPTS = 3; // Times a local window is doubled before sparse planning gives up
+const static double SMALLEST_VALID_SEGMENT = 0.05;
+
+// Warm start constants
+const static double WARM_START_POSITION_TOLERANCE = 1e-6; // (m) Points closer than this to their previous pose
+const static double WARM_START_ANGLE_TOLERANCE = 1e-6;    // (rad) keep their previous joint solution
+const static double WARM_START_MIN_MATCHING = 0.5; // Fraction of unchanged points below which a path is planned
+                                                   // from scratch
+
+/**
+ * @brief Checks the joint interpolated motion from \e pt_a to \e pt_b for collisions. The end
+ * points themselves are not checked.
+ */
+static bool isMotionCollisionFree(const std::vector<double>& pt_a, const std::vector<double>& pt_b,
+                                  const descartes_core::RobotModel& model, const double min_segment_size)
+{
+  auto interpolate = godel_process_planning::interpolateJoint(pt_a, pt_b, min_segment_size);
+
+  // The thought here is that the graph building process already checks the waypoints in the
+  // trajectory for collisions. What we want to do is check between these waypoints when they
+  // move a lot. 'interpolateJoint()' returns a list of positions where the maximum joint motion
+  // between them is no more 'than min_segment_size' and its inclusive. So if there are only two
+  // solutions, then we just have the start & end which are already checked.
+  if (interpolate.size() > 2)
+  {
+    for (std::size_t j = 1; j < interpolate.size() - 1; ++j)
+    {
+      if (!model.isValid(interpolate[j]))
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
 
 const static bool validateTrajectory(const trajectory_msgs::JointTrajectory& pts,
                                      const descartes_core::RobotModel& model,
@@ -13,38 +54,37 @@ const static bool validateTrajectory(const trajectory_msgs::JointTrajectory& pts
 {
   for (std::size_t i = 1; i < pts.points.size(); ++i)
   {
-    const auto& pt_a = pts.points[i - 1].positions;
-    const auto& pt_b = pts.points[i].positions;
-
-    auto interpolate = godel_process_planning::interpolateJoint(pt_a, pt_b, min_segment_size);
-
-    // The thought here is that the graph building process already checks the waypoints in the
-    // trajectory for collisions. What we want to do is check between these waypoints when they
-    // move a lot. 'interpolateJoint()' returns a list of positions where the maximum joint motion
-    // between them is no more 'than min_segment_size' and its inclusive. So if there are only two
-    // solutions, then we just have the start & end which are already checked.
-    if (interpolate.size() > 2)
+    if (!isMotionCollisionFree(pts.points[i - 1].positions, pts.points[i].positions, model, min_segment_size))
     {
-      for (std::size_t j = 1; j < interpolate.size() - 1; ++j)
-      {
-        if (!model.isValid(interpolate[j]))
-        {
-          return false;
-        }
-      }
+      return false;
     }
   }
   return true;
 }
 
-bool godel_process_planning::generateMotionPlan(const descartes_core::RobotModelPtr model,
-                                                const std::vector<descartes_core::TrajectoryPtPtr> &traj,
-                                                moveit::core::RobotModelConstPtr moveit_model,
-                                                const std::string &move_group_name,
-                                                const std::vector<double> &start_state,
-                                                godel_msgs::ProcessPlan &plan)
+/**
+ * @brief True if the robot can move from \e from to \e to within \e timing without colliding on the way
+ */
+static bool isValidTransition(const descartes_core::RobotModel& model, const std::vector<double>& from,
+                              const std::vector<double>& to, const descartes_core::TimingConstraint& timing)
 {
+  if (timing.isSpecified() && !model.isValidMove(from, to, timing.upper))
+  {
+    return false;
+  }
+  return isMotionCollisionFree(from, to, model, SMALLEST_VALID_SEGMENT);
+}
 
+/**
+ * @brief Builds the full planning graph of \e traj and searches it for the cheapest path, where
+ * starting configurations are weighted by the cost of a free move from \e start_state
+ * @param joints Output parameter - one joint configuration per point of \e traj
+ */
+static bool denseSearch(const descartes_core::RobotModelPtr model,
+                        const godel_process_planning::DescartesTraj& traj,
+                        const std::vector<double>& start_state,
+                        std::vector<std::vector<double>>& joints)
+{
   // Generate a graph of the process path joint solutions
   descartes_planner::PlanningGraph planning_graph (model);
   if (!planning_graph.insertGraph(traj)) // builds the graph out
@@ -71,7 +111,7 @@ bool godel_process_planning::generateMotionPlan(const descartes_core::RobotModel
   std::vector<double> process_start_costs (process_start_poses.size());
   for (std::size_t i = 0; i < process_start_costs.size(); ++i) // This computes the list of configurations
   {
-    process_start_costs[i] = freeSpaceCostFunction(start_state, process_start_poses[i]);
+    process_start_costs[i] = godel_process_planning::freeSpaceCostFunction(start_state, process_start_poses[i]);
   }
 
   // Now we perform the search using the starting costs from our estimation above
@@ -84,36 +124,343 @@ bool godel_process_planning::generateMotionPlan(const descartes_core::RobotModel
     return false;
   }
 
-  // Here we search the graph for the shortest path and build a descartes trajectory of it!
+  // Here we search the graph for the shortest path
   auto path_idxs = search.shortestPath();
   ROS_INFO("%s: Descartes computed path with cost %lf", __FUNCTION__, cost);
-  DescartesTraj solution;
+  joints.clear();
   for (size_t i = 0; i < path_idxs.size(); ++i)
   {
-    const auto idx = path_idxs[i];
-    const auto* data = graph.vertex(i, idx);
-    const auto& tm = graph.getRung(i).timing;
-    auto pt = descartes_core::TrajectoryPtPtr(new descartes_trajectory::JointTrajectoryPt(std::vector<double>(data, data + dof), tm));
-    solution.push_back(pt);
+    const auto* data = graph.vertex(i, path_idxs[i]);
+    joints.push_back(std::vector<double>(data, data + dof));
   }
+  return true;
+}
 
-  // Now we plan our approach and depart to/from the path. We try to joint interpolate, and then we run from there
+/**
+ * @brief Checks every transition of \e joints for velocity and collisions and replans the points around a
+ * transition that fails densely, growing the window a few times if the replanned stretch does not join up
+ * with its neighbors.
+ * @param joints In/out parameter - one joint configuration per point of \e traj
+ * @return False if a window could not be repaired
+ */
+static bool repairSolution(const descartes_core::RobotModelPtr model,
+                           const godel_process_planning::DescartesTraj& traj,
+                           const std::vector<double>& start_state,
+                           std::vector<std::vector<double>>& joints)
+{
+  // Walk the transitions in order, so that a window always starts from already validated joints
+  std::size_t n_replanned = 0;
+  for (std::size_t i = 1; i < traj.size(); ++i)
+  {
+    if (isValidTransition(*model, joints[i - 1], joints[i], traj[i]->getTiming()))
+    {
+      continue;
+    }
+
+    bool repaired = false;
+    std::size_t margin = LOCAL_REPLAN_MARGIN;
+    for (int attempt = 0; attempt < LOCAL_REPLAN_ATTEMPTS && !repaired; ++attempt, margin *= 2)
+    {
+      // Points [lo, hi] are replaced
+      const std::size_t lo = i > margin ? i - margin : 0;
+      const std::size_t hi = std::min(i - 1 + margin, traj.size() - 1);
+
+      godel_process_planning::DescartesTraj window (traj.begin() + lo, traj.begin() + hi + 1);
+      const std::vector<double>& anchor = lo > 0 ? joints[lo - 1] : start_state;
+
+      std::vector<std::vector<double>> local;
+      if (!denseSearch(model, window, anchor, local))
+      {
+        continue;
+      }
+
+      repaired = (lo == 0 || isValidTransition(*model, joints[lo - 1], local.front(), traj[lo]->getTiming())) &&
+                 (hi == traj.size() - 1 ||
+                  isValidTransition(*model, local.back(), joints[hi + 1], traj[hi + 1]->getTiming()));
+      if (repaired)
+      {
+        std::copy(local.begin(), local.end(), joints.begin() + lo);
+        n_replanned += local.size();
+        i = hi; // the replanned points were checked by the search, resume after the window
+      }
+    }
+
+    if (!repaired)
+    {
+      ROS_WARN("%s: Could not repair solution near point %lu", __FUNCTION__, i);
+      return false;
+    }
+  }
+
+  ROS_INFO("%s: %lu of %lu points needed to be replanned densely", __FUNCTION__, n_replanned, traj.size());
+  return true;
+}
+
+/**
+ * @brief Solves \e traj with the Descartes sparse planner, which only searches a subsample of the points
+ * and fills in the rest by interpolation, then repairs the transitions of the result that are invalid.
+ * @param joints Output parameter - one joint configuration per point of \e traj
+ * @return False if the sparse planner or a local replan failed; the caller should plan densely instead
+ */
+static bool sparseSearch(const descartes_core::RobotModelPtr model,
+                         const godel_process_planning::DescartesTraj& traj,
+                         const std::vector<double>& start_state,
+                         std::vector<std::vector<double>>& joints)
+{
+  descartes_planner::SparsePlanner planner;
+  if (!planner.initialize(model))
+  {
+    ROS_ERROR("%s: Failed to initialize sparse planner with robot model", __FUNCTION__);
+    return false;
+  }
+  planner.setSampling(SPARSE_SAMPLING);
+
+  godel_process_planning::DescartesTraj sparse_solution;
+  if (!planner.planPath(traj) || !planner.getPath(sparse_solution) || sparse_solution.size() != traj.size())
+  {
+    ROS_WARN("%s: Sparse planner failed to solve the trajectory", __FUNCTION__);
+    return false;
+  }
+
+  joints.clear();
+  for (const auto& pt : sparse_solution)
+  {
+    joints.push_back(godel_process_planning::extractJoints(*model, *pt));
+  }
+
+  return repairSolution(model, traj, start_state, joints);
+}
+
+static bool posesMatch(const Eigen::Affine3d& a, const Eigen::Affine3d& b)
+{
+  return (a.translation() - b.translation()).norm() < WARM_START_POSITION_TOLERANCE &&
+         Eigen::Quaterniond(a.rotation()).angularDistance(Eigen::Quaterniond(b.rotation())) <
+             WARM_START_ANGLE_TOLERANCE;
+}
+
+/**
+ * @brief Builds a solution for \e traj from the previous solution of the same path without searching a
+ * graph. Points whose pose did not change keep their previous joints; the others take the IK solution
+ * closest to the previous joints of the same point. The result is then repaired like a sparse
+ * solution. Only paths with the same number of points, most of them unchanged, are warm-started.
+ * @param poses The nominal tool pose of each point of \e traj
+ * @param joints Output parameter - one joint configuration per point of \e traj
+ * @return False if no usable solution could be built; the caller should search from scratch instead
+ */
+static bool warmStartSearch(const descartes_core::RobotModelPtr model,
+                            const godel_process_planning::DescartesTraj& traj,
+                            const EigenSTL::vector_Affine3d& poses,
+                            const std::vector<double>& start_state,
+                            const godel_process_planning::PreviousSolution& previous,
+                            std::vector<std::vector<double>>& joints)
+{
+  // Points only correspond to their previous selves if the layout of the path is unchanged
+  if (previous.poses.size() != traj.size() || previous.joints.size() != traj.size())
+  {
+    ROS_INFO("%s: Path changed from %lu to %lu points", __FUNCTION__, previous.poses.size(), traj.size());
+    return false;
+  }
+
+  std::vector<bool> unchanged (traj.size());
+  std::size_t n_unchanged = 0;
+  for (std::size_t i = 0; i < traj.size(); ++i)
+  {
+    unchanged[i] = posesMatch(poses[i], previous.poses[i]);
+    n_unchanged += unchanged[i] ? 1 : 0;
+  }
+
+  if (n_unchanged < WARM_START_MIN_MATCHING * traj.size())
+  {
+    ROS_INFO("%s: Only %lu of %lu points are unchanged", __FUNCTION__, n_unchanged, traj.size());
+    return false;
+  }
+
+  joints.resize(traj.size());
+  std::size_t n_reused = 0;
+  for (std::size_t i = 0; i < traj.size(); ++i)
+  {
+    const auto& seed = previous.joints[i];
+    if (unchanged[i] && model->isValid(seed))
+    {
+      joints[i] = seed;
+      ++n_reused;
+    }
+    else if (!traj[i]->getClosestJointPose(seed, *model, joints[i]))
+    {
+      ROS_WARN("%s: No IK solution near the previous solution for point %lu", __FUNCTION__, i);
+      return false;
+    }
+  }
+
+  ROS_INFO("%s: Reused the previous joints of %lu of %lu points", __FUNCTION__, n_reused, traj.size());
+  return repairSolution(model, traj, start_state, joints);
+}
+
+/**
+ * @brief Finds the joint solution of one process path, warm-started from \e previous if possible, then
+ * sparse or dense as requested
+ * @param poses Output parameter - the nominal tool pose of each point of \e traj, for the next warm start
+ * @param joints Output parameter - one joint configuration per point of \e traj
+ */
+static bool solveProcessPath(const descartes_core::RobotModelPtr model,
+                             const godel_process_planning::DescartesTraj& traj,
+                             const std::vector<double>& start_state, bool sparse,
+                             const godel_process_planning::PreviousSolution* previous,
+                             EigenSTL::vector_Affine3d& poses,
+                             std::vector<std::vector<double>>& joints)
+{
+  poses.resize(traj.size());
+  for (std::size_t i = 0; i < traj.size(); ++i)
+  {
+    traj[i]->getNominalCartPose(std::vector<double>(), *model, poses[i]);
+  }
+
+  bool solved = false;
+  if (previous && !previous->joints.empty())
+  {
+    solved = warmStartSearch(model, traj, poses, start_state, *previous, joints);
+    if (!solved)
+    {
+      ROS_WARN("%s: Previous solution could not be reused, searching from scratch", __FUNCTION__);
+    }
+  }
+
+  if (!solved && sparse)
+  {
+    solved = sparseSearch(model, traj, start_state, joints);
+    if (!solved)
+    {
+      ROS_WARN("%s: Falling back to dense planning", __FUNCTION__);
+    }
+  }
+
+  return solved || denseSearch(model, traj, start_state, joints);
+}
+
+/**
+ * @brief Appends \e next to \e traj, shifted in time to start where \e traj ends. The first point of
+ * \e next is dropped if it repeats the last point of \e traj.
+ */
+static void appendTrajectory(trajectory_msgs::JointTrajectory& traj, const trajectory_msgs::JointTrajectory& next)
+{
+  if (next.points.empty())
+  {
+    return;
+  }
+
+  const ros::Duration offset = traj.points.empty() ? ros::Duration(0.0) : traj.points.back().time_from_start;
+  std::size_t first = 0;
+  if (!traj.points.empty())
+  {
+    const auto& a = traj.points.back().positions;
+    const auto& b = next.points.front().positions;
+    bool repeated = a.size() == b.size();
+    for (std::size_t j = 0; j < a.size() && repeated; ++j)
+    {
+      repeated = std::abs(a[j] - b[j]) < 1e-6;
+    }
+    first = repeated ? 1 : 0;
+  }
+
+  for (std::size_t i = first; i < next.points.size(); ++i)
+  {
+    trajectory_msgs::JointTrajectoryPoint pt = next.points[i];
+    pt.time_from_start += offset;
+    traj.points.push_back(pt);
+  }
+}
+
+bool godel_process_planning::generateMotionPlan(const descartes_core::RobotModelPtr model,
+                                                const std::vector<descartes_core::TrajectoryPtPtr> &traj,
+                                                moveit::core::RobotModelConstPtr moveit_model,
+                                                const std::string &move_group_name,
+                                                const std::vector<double> &start_state,
+                                                godel_msgs::ProcessPlan &plan,
+                                                bool sparse,
+                                                PreviousSolution* previous,
+                                                FreeSpaceRoadmap* roadmap)
+{
+  return generateJobPlan(model, std::vector<DescartesTraj>(1, traj), moveit_model, move_group_name, start_state,
+                         plan, sparse, std::vector<PreviousSolution*>(1, previous), roadmap);
+}
+
+bool godel_process_planning::generateJobPlan(const descartes_core::RobotModelPtr model,
+                                             const std::vector<DescartesTraj>& trajs,
+                                             moveit::core::RobotModelConstPtr moveit_model,
+                                             const std::string& move_group_name,
+                                             const std::vector<double>& start_state,
+                                             godel_msgs::ProcessPlan& plan,
+                                             bool sparse,
+                                             const std::vector<PreviousSolution*>& previous,
+                                             FreeSpaceRoadmap* roadmap,
+                                             std::vector<std::size_t>* process_offsets)
+{
+  if (trajs.empty() || previous.size() != trajs.size())
+  {
+    ROS_ERROR("%s: Expected one previous solution slot per path", __FUNCTION__);
+    return false;
+  }
+
+  // Each path starts from where the one before it ended
+  std::vector<std::vector<std::vector<double>>> solutions (trajs.size());
+  std::vector<EigenSTL::vector_Affine3d> poses (trajs.size());
+  std::vector<double> seed = start_state;
+  for (std::size_t k = 0; k < trajs.size(); ++k)
+  {
+    if (trajs[k].empty() ||
+        !solveProcessPath(model, trajs[k], seed, sparse, previous[k], poses[k], solutions[k]))
+    {
+      ROS_ERROR("%s: Failed to solve path %lu of %lu", __FUNCTION__, k + 1, trajs.size());
+      return false;
+    }
+    seed = solutions[k].back();
+  }
+
+  // Now we plan our approach and depart to/from the job and the moves between its paths. We try to joint
+  // interpolate, and then we run from there
   try
   {
     trajectory_msgs::JointTrajectory approach =
         planFreeMove(*model, move_group_name, moveit_model,
                      start_state,
-                     extractJoints(*model, *solution.front()));
+                     solutions.front().front(), roadmap);
 
     trajectory_msgs::JointTrajectory depart = planFreeMove(
         *model, move_group_name, moveit_model,
-        extractJoints(*model, *solution.back()),
-        start_state);
+        solutions.back().back(),
+        start_state, roadmap);
+
+    // Convert each process path to ROS messages with the timing of the request and chain them
+    trajectory_msgs::JointTrajectory process;
+    if (process_offsets)
+    {
+      process_offsets->clear();
+    }
+    for (std::size_t k = 0; k < trajs.size(); ++k)
+    {
+      if (k > 0)
+      {
+        appendTrajectory(process, planFreeMove(*model, move_group_name, moveit_model, solutions[k - 1].back(),
+                                               solutions[k].front(), roadmap));
+      }
 
-    // Break out the process path from the seed path and convert to ROS messages
-    trajectory_msgs::JointTrajectory process = toROSTrajectory(solution, *model);
+      DescartesTraj solution;
+      for (size_t i = 0; i < solutions[k].size(); ++i)
+      {
+        const auto& tm = trajs[k][i]->getTiming();
+        solution.push_back(descartes_core::TrajectoryPtPtr(
+            new descartes_trajectory::JointTrajectoryPt(solutions[k][i], tm)));
+      }
+
+      // The connecting move ends on the first point of this path, which is then dropped when appending
+      const trajectory_msgs::JointTrajectory path_traj = toROSTrajectory(solution, *model);
+      appendTrajectory(process, path_traj);
+      if (process_offsets)
+      {
+        process_offsets->push_back(process.points.size() - path_traj.points.size());
+      }
+    }
 
-    const static double SMALLEST_VALID_SEGMENT = 0.05;
     if (!validateTrajectory(process, *model, SMALLEST_VALID_SEGMENT))
     {
       ROS_ERROR_STREAM("%s: Computed path contains joint configuration changes that would result in a collision.");
@@ -132,6 +479,16 @@ bool godel_process_planning::generateMotionPlan(const descartes_core::RobotModel
     godel_process_planning::fillTrajectoryHeaders(joint_names, plan.trajectory_approach);
     godel_process_planning::fillTrajectoryHeaders(joint_names, plan.trajectory_depart);
     godel_process_planning::fillTrajectoryHeaders(joint_names, plan.trajectory_process);
+
+    // Only a job that planned completely is worth warm-starting from
+    for (std::size_t k = 0; k < trajs.size(); ++k)
+    {
+      if (previous[k])
+      {
+        previous[k]->poses = poses[k];
+        previous[k]->joints = solutions[k];
+      }
+    }
     return true;
   }
   catch (const std::runtime_error& e)
@@ -4,10 +4,44 @@
 #include <descartes_core/robot_model.h>
 #include <descartes_core/trajectory_pt.h>
 #include <godel_msgs/ProcessPlan.h>
+#include <eigen_stl_containers/eigen_stl_vector_container.h>
+#include "common_utils.h"
+#include <map>
+#include <memory>
 
 namespace godel_process_planning
 {
 
+/**
+ * @brief The joint solution of a previously planned process path, kept so that replanning the
+ * same path can start from it instead of searching a new planning graph
+ */
+struct PreviousSolution
+{
+  EigenSTL::vector_Affine3d poses;         // nominal tool pose of each process point
+  std::vector<std::vector<double>> joints; // joint solution of each process point
+};
+
+/**
+ * @brief The warm start slot of the path \e name in \e solutions, created if needed; null for an
+ * unnamed path
+ */
+inline PreviousSolution* findPreviousSolution(std::map<std::string, std::shared_ptr<PreviousSolution>>& solutions,
+                                              const std::string& name)
+{
+  if (name.empty())
+  {
+    return nullptr;
+  }
+
+  auto& entry = solutions[name];
+  if (!entry)
+  {
+    entry = std::make_shared<PreviousSolution>();
+  }
+  return entry.get();
+}
+
 /**
  * @brief This is a helper function for doing the joint level trajectory planning for a
  * a robot from a given \e start_state to and through the process path defined by \e
@@ -19,6 +53,14 @@ namespace godel_process_planning
  * @param start_state The initial position of the robot
  * @param plan Output parameter - the approach, process, and departure joint paths.
  * NOTE THAT ProcessPlan::type is NOT set.
+ * @param sparse If true, the process path is first solved on a subsample of its points and only
+ * the stretches where that solution is invalid are planned densely. Falls back to a fully dense
+ * search if this fails.
+ * @param previous If given and not empty, the search is warm-started from this solution of the same
+ * path: unchanged points keep their joints and only the transitions that became invalid are replanned.
+ * This is only done if the path has as many points as before and most of them are unchanged. It is
+ * overwritten with the new solution once the whole plan succeeds, and left as is otherwise.
+ * @param roadmap Optional roadmap used and grown when planning the approach and depart moves
  * @return True on planning success, false otherwise
  */
 bool generateMotionPlan(const descartes_core::RobotModelPtr model,
@@ -26,7 +68,32 @@ bool generateMotionPlan(const descartes_core::RobotModelPtr model,
                         moveit::core::RobotModelConstPtr moveit_model,
                         const std::string& move_group_name,
                         const std::vector<double>& start_state,
-                        godel_msgs::ProcessPlan& plan);
+                        godel_msgs::ProcessPlan& plan,
+                        bool sparse = false,
+                        PreviousSolution* previous = nullptr,
+                        FreeSpaceRoadmap* roadmap = nullptr);
+
+/**
+ * @brief Plans several process paths as one job. Each path is approached from the end of the one
+ * before it, the moves between paths are planned as free space moves, and the robot only returns to
+ * \e start_state after the last path. The process paths and the moves between them make up the
+ * process trajectory of \e plan.
+ * @param trajs The process paths in the order they are to be executed
+ * @param previous One warm start slot per path; entries may be null
+ * @param process_offsets If given, filled with the index in plan.trajectory_process of the first point
+ * of each path
+ * @return True on planning success, false otherwise
+ */
+bool generateJobPlan(const descartes_core::RobotModelPtr model,
+                     const std::vector<DescartesTraj>& trajs,
+                     moveit::core::RobotModelConstPtr moveit_model,
+                     const std::string& move_group_name,
+                     const std::vector<double>& start_state,
+                     godel_msgs::ProcessPlan& plan,
+                     bool sparse,
+                     const std::vector<PreviousSolution*>& previous,
+                     FreeSpaceRoadmap* roadmap = nullptr,
+                     std::vector<std::size_t>* process_offsets = nullptr);
 
 
 }
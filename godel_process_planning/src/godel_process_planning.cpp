@@ -1,12 +1,23 @@
 #include "godel_process_planning/godel_process_planning.h"
 #include <moveit/robot_model_loader/robot_model_loader.h>
+#include "free_space_roadmap.h"
+#include "part_height_map.h"
+
+const static std::string JOINT_TOPIC_NAME = "joint_states"; // ROS topic to subscribe to for robot state
+const static std::string PART_COLLISION_OBJECT_TOPIC = "collision_object";
+const static std::string PART_COLLISION_OBJECT_ID = "scanned_part";
+const static double DEFAULT_PART_CLEARANCE = 0.1; // (m) enough for the tool to hop over the part
 
 godel_process_planning::ProcessPlanningManager::ProcessPlanningManager(
     const std::string& world_frame, const std::string& blend_group, const std::string& blend_tcp,
     const std::string& keyence_group, const std::string& keyence_tcp,
     const std::string& robot_model_plugin)
     : plugin_loader_("descartes_core", "descartes_core::RobotModel"),
-      blend_group_name_(blend_group), keyence_group_name_(keyence_group)
+      blend_group_name_(blend_group), keyence_group_name_(keyence_group),
+      joint_states_(new godel_utils::JointStateCache(JOINT_TOPIC_NAME)),
+      blend_roadmap_(std::make_shared<FreeSpaceRoadmap>()),
+      keyence_roadmap_(std::make_shared<FreeSpaceRoadmap>()),
+      part_map_(std::make_shared<PartHeightMap>())
 {
   // Attempt to load and initialize the blending robot model
   blend_model_ = plugin_loader_.createInstance(robot_model_plugin);
@@ -40,4 +51,31 @@ godel_process_planning::ProcessPlanningManager::ProcessPlanningManager(
   {
     throw std::runtime_error("Could not load moveit robot model");
   }
+
+  // Follow the scanned part as it is added to the planning scene
+  ros::NodeHandle nh, pnh("~");
+  pnh.param("part_clearance", part_clearance_, DEFAULT_PART_CLEARANCE);
+  part_object_sub_ = nh.subscribe(PART_COLLISION_OBJECT_TOPIC, 1,
+                                  &ProcessPlanningManager::partCollisionObjectCallback, this);
+}
+
+void godel_process_planning::ProcessPlanningManager::partCollisionObjectCallback(
+    const moveit_msgs::CollisionObjectConstPtr& object)
+{
+  // Other objects in the scene are of no concern to the transitions
+  if (object->id == PART_COLLISION_OBJECT_ID)
+  {
+    part_map_->update(*object);
+  }
+}
+
+void godel_process_planning::ProcessPlanningManager::checkDetection(unsigned detection_id)
+{
+  // Path names are reused for the surfaces of a new detection, so the old solutions no longer apply
+  if (detection_id != detection_id_)
+  {
+    previous_blend_solutions_.clear();
+    previous_scan_solutions_.clear();
+    detection_id_ = detection_id;
+  }
 }
@@ -13,8 +13,6 @@
 namespace godel_process_planning
 {
 
-const static std::string JOINT_TOPIC_NAME =
-    "joint_states"; // ROS topic to subscribe to for robot state
 /**
  * @brief Translated an Eigen pose to a Descartes trajectory point appropriate for the scan process!
  *        Mirros the function in blend_process_planning.cpp document.
@@ -55,6 +53,7 @@ bool ProcessPlanningManager::handleKeyencePlanning(godel_msgs::KeyenceProcessPla
                                                    godel_msgs::KeyenceProcessPlanning::Response& res)
 {
   keyence_model_->setCheckCollisions(true);
+  checkDetection(req.detection_id);
   // Precondition: Input trajectory must be non-zero
   if (req.path.segments.empty())
   {
@@ -62,33 +61,97 @@ bool ProcessPlanningManager::handleKeyencePlanning(godel_msgs::KeyenceProcessPla
     return true;
   }
 
-  if (req.path.segments.size() > 1)
+  // Precondition: Points are timed by the scan and traverse speeds, which must be positive
+  if (req.params.scan_spd <= 0.0 || req.params.traverse_spd <= 0.0)
   {
-    ROS_WARN("%s: Currently we do not support scan paths w/ more than 1 segment."
-             " Planning only for the first.", __FUNCTION__);
+    ROS_ERROR("%s: Scan speed (%f m/s) and traverse speed (%f m/s) must be positive", __FUNCTION__,
+              req.params.scan_spd, req.params.traverse_spd);
+    return false;
+  }
+
+  // Precondition: Chained paths are either all named or all unnamed
+  if (!req.chained_names.empty() && req.chained_names.size() != req.chained_paths.size())
+  {
+    ROS_ERROR("%s: Request named %lu of %lu chained paths", __FUNCTION__, req.chained_names.size(),
+              req.chained_paths.size());
+    return false;
+  }
+
+  std::vector<godel_msgs::ProcessPath> paths (1, req.path);
+  paths.insert(paths.end(), req.chained_paths.begin(), req.chained_paths.end());
+
+  // Precondition: All input segments must have at least one pose associated with them
+  for (const auto& path : paths)
+  {
+    if (path.segments.empty())
+    {
+      ROS_ERROR("%s: Chained path contained no trajectory segments", __FUNCTION__);
+      return false;
+    }
+
+    for (const auto& segment : path.segments)
+    {
+      if (segment.poses.empty())
+      {
+        ROS_ERROR("Input trajectory segment contained no poses. Invalid input.");
+        return false;
+      }
+    }
   }
 
   // Transform process path from geometry msgs to descartes points
   const static double LINEAR_DISCRETIZATION = 0.01; // meters
   const static double ANGULAR_DISCRETIZATION = 0.1; // radians
+  const static double CHORDAL_TOLERANCE = 0.0005; // meters
+  const static double ANGULAR_TOLERANCE = 0.02; // radians
+  const static double MAX_LINEAR_DISCRETIZATION = 0.05; // meters
   const static double RETRACT_DISTANCE = 0.05; // meters
 
   TransitionParameters transition_params;
   transition_params.linear_disc = LINEAR_DISCRETIZATION;
   transition_params.angular_disc = ANGULAR_DISCRETIZATION;
+  transition_params.chordal_tol = CHORDAL_TOLERANCE;
+  transition_params.angular_tol = ANGULAR_TOLERANCE;
+  transition_params.max_disc = MAX_LINEAR_DISCRETIZATION;
   transition_params.retract_dist = RETRACT_DISTANCE;
   transition_params.traverse_height = req.params.approach_distance;
   transition_params.z_adjust = req.params.z_adjust;
+  transition_params.traverse_speed = req.params.traverse_spd;
+  transition_params.part = part_map_.get();
+  transition_params.part_clearance = part_clearance_;
+
+  // Segments are scanned at scan speed, the moves between them run at traverse speed with the laser off
+  std::vector<DescartesTraj> process_points;
+  std::vector<std::vector<SegmentRange>> segment_ranges (paths.size());
+  std::vector<PreviousSolution*> previous;
+  for (std::size_t k = 0; k < paths.size(); ++k)
+  {
+    process_points.push_back(toDescartesTraj(paths[k].segments, req.params.scan_spd, transition_params,
+                                             toDescartesScanPt, &segment_ranges[k]));
+    const std::string name = k == 0 ? req.name : (req.chained_names.empty() ? "" : req.chained_names[k - 1]);
+    previous.push_back(findPreviousSolution(previous_scan_solutions_, name));
+  }
 
-  DescartesTraj process_points = toDescartesTraj(req.path.segments, req.params.traverse_spd, transition_params,
-                                                 toDescartesScanPt);
-  // Capture the current state of the robot
-  std::vector<double> current_joints = getCurrentJointState(JOINT_TOPIC_NAME);
+  // Capture the current state of the robot, unless the plan is to start elsewhere
+  std::vector<double> current_joints =
+      req.start_state.empty() ? getCurrentJointState(*joint_states_) : req.start_state;
 
-  if (generateMotionPlan(keyence_model_, process_points, moveit_model_, keyence_group_name_,
-                         current_joints, res.plan))
+  std::vector<std::size_t> process_offsets;
+  if (generateJobPlan(keyence_model_, process_points, moveit_model_, keyence_group_name_,
+                      current_joints, res.plan, req.params.sparse_planning, previous,
+                      keyence_roadmap_.get(), &process_offsets))
   {
     res.plan.type = res.plan.SCAN_TYPE;
+
+    // Each path has one point per Descartes point, starting at its offset in the process trajectory
+    for (std::size_t k = 0; k < paths.size(); ++k)
+    {
+      for (const auto& range : segment_ranges[k])
+      {
+        res.plan.scan_segment_starts.push_back(static_cast<int>(process_offsets[k] + range.first));
+        res.plan.scan_segment_stops.push_back(static_cast<int>(process_offsets[k] + range.second));
+      }
+    }
     return true;
   }
   else
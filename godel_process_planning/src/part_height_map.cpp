@@ -0,0 +1,99 @@
+#include "part_height_map.h"
+
+#include <shape_msgs/SolidPrimitive.h>
+#include <ros/console.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/**
+ * @brief Tests whether the 2D segment from \e a to \e b touches the rectangle [min_x, max_x] x
+ * [min_y, max_y] (slab clipping)
+ */
+static bool segmentHitsRectangle(const Eigen::Vector2d& a, const Eigen::Vector2d& b, double min_x, double max_x,
+                                 double min_y, double max_y)
+{
+  const Eigen::Vector2d d = b - a;
+  const double lo[2] = {min_x, min_y};
+  const double hi[2] = {max_x, max_y};
+  double t_enter = 0.0;
+  double t_exit = 1.0;
+
+  for (int k = 0; k < 2; ++k)
+  {
+    if (std::abs(d[k]) < std::numeric_limits<double>::epsilon())
+    {
+      if (a[k] < lo[k] || a[k] > hi[k])
+      {
+        return false;
+      }
+      continue;
+    }
+
+    double t0 = (lo[k] - a[k]) / d[k];
+    double t1 = (hi[k] - a[k]) / d[k];
+    if (t0 > t1)
+    {
+      std::swap(t0, t1);
+    }
+    t_enter = std::max(t_enter, t0);
+    t_exit = std::min(t_exit, t1);
+    if (t_enter > t_exit)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+void godel_process_planning::PartHeightMap::update(const moveit_msgs::CollisionObject& object)
+{
+  columns_.clear();
+  if (object.operation == moveit_msgs::CollisionObject::REMOVE)
+  {
+    return;
+  }
+
+  for (std::size_t i = 0; i < object.primitives.size() && i < object.primitive_poses.size(); ++i)
+  {
+    const auto& primitive = object.primitives[i];
+    if (primitive.type != shape_msgs::SolidPrimitive::BOX ||
+        primitive.dimensions.size() < 3)
+    {
+      continue;
+    }
+
+    const auto& center = object.primitive_poses[i].position;
+    const double half_x = 0.5 * primitive.dimensions[shape_msgs::SolidPrimitive::BOX_X];
+    const double half_y = 0.5 * primitive.dimensions[shape_msgs::SolidPrimitive::BOX_Y];
+    const double half_z = 0.5 * primitive.dimensions[shape_msgs::SolidPrimitive::BOX_Z];
+
+    Column c;
+    c.min_x = center.x - half_x;
+    c.max_x = center.x + half_x;
+    c.min_y = center.y - half_y;
+    c.max_y = center.y + half_y;
+    c.top = center.z + half_z;
+    columns_.push_back(c);
+  }
+
+  ROS_INFO("%s: Part model '%s' has %lu columns", __FUNCTION__, object.id.c_str(), columns_.size());
+}
+
+double godel_process_planning::PartHeightMap::maxHeight(const Eigen::Vector3d& a, const Eigen::Vector3d& b,
+                                                        double radius) const
+{
+  // Growing each column by the radius turns the corridor test into a segment/rectangle test
+  const Eigen::Vector2d a2 (a.x(), a.y());
+  const Eigen::Vector2d b2 (b.x(), b.y());
+  double height = -std::numeric_limits<double>::infinity();
+  for (const auto& c : columns_)
+  {
+    if (c.top > height && segmentHitsRectangle(a2, b2, c.min_x - radius, c.max_x + radius,
+                                               c.min_y - radius, c.max_y + radius))
+    {
+      height = c.top;
+    }
+  }
+  return height;
+}
@@ -0,0 +1,48 @@
+#ifndef GODEL_PROCESS_PLANNING_PART_HEIGHT_MAP_H
+#define GODEL_PROCESS_PLANNING_PART_HEIGHT_MAP_H
+
+#include <moveit_msgs/CollisionObject.h>
+#include <Eigen/Geometry>
+#include <vector>
+
+namespace godel_process_planning
+{
+
+/**
+ * @brief Top-down model of the scanned part, built from the box columns of its collision object.
+ * Lets the transitions between process segments hop just high enough to clear the part instead of
+ * climbing to a fixed safe height.
+ */
+class PartHeightMap
+{
+public:
+  /**
+   * @brief Replaces the model with the box primitives of \e object, or clears it if the object is
+   * being removed. Other shapes are ignored. Boxes are assumed to be axis aligned in the world frame.
+   */
+  void update(const moveit_msgs::CollisionObject& object);
+
+  void clear() { columns_.clear(); }
+
+  bool empty() const { return columns_.empty(); }
+
+  /**
+   * @brief Highest point of the part that lies within \e radius (horizontally) of the segment from
+   * \e a to \e b; -infinity if there is none
+   */
+  double maxHeight(const Eigen::Vector3d& a, const Eigen::Vector3d& b, double radius) const;
+
+private:
+  struct Column
+  {
+    double min_x, max_x;
+    double min_y, max_y;
+    double top;
+  };
+
+  std::vector<Column> columns_;
+};
+
+}
+
+#endif // GODEL_PROCESS_PLANNING_PART_HEIGHT_MAP_H
@@ -98,33 +98,116 @@ static EigenSTL::vector_Affine3d retractPath(const Eigen::Affine3d& start, doubl
   return result;
 }
 
+/**
+ * @brief Drops the poses of \e poses that a straight, slerped move between their kept neighbors
+ * would reproduce. Each kept pose is followed by the farthest pose such that every pose in between
+ * lies within \e chordal_tol of the chord and within \e angular_tol of the orientation interpolated
+ * at its projection onto the chord. The first and last poses are always kept. As in
+ * polygon_utils::simplify, a non-positive \e chordal_tol keeps every pose.
+ * @param max_step Kept poses are never farther apart than this (meters); 0 for no limit
+ */
+static EigenSTL::vector_Affine3d thinPath(const EigenSTL::vector_Affine3d& poses, const double chordal_tol,
+                                          const double angular_tol, const double max_step)
+{
+  if (poses.size() < 3 || chordal_tol <= 0.0)
+  {
+    return poses;
+  }
+
+  auto within_tolerance = [&poses, chordal_tol, angular_tol](std::size_t from, std::size_t to)
+  {
+    const Eigen::Vector3d a = poses[from].translation();
+    const Eigen::Vector3d chord = poses[to].translation() - a;
+    const double chord_len2 = chord.squaredNorm();
+    const Eigen::Quaterniond q_from (poses[from].rotation());
+    const Eigen::Quaterniond q_to (poses[to].rotation());
+
+    for (std::size_t k = from + 1; k < to; ++k)
+    {
+      const Eigen::Vector3d rel = poses[k].translation() - a;
+      double t = chord_len2 > 0.0 ? rel.dot(chord) / chord_len2 : 0.0;
+      t = std::min(1.0, std::max(0.0, t));
+
+      if ((rel - t * chord).norm() > chordal_tol)
+      {
+        return false;
+      }
+      if (q_from.slerp(t, q_to).angularDistance(Eigen::Quaterniond(poses[k].rotation())) > angular_tol)
+      {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  EigenSTL::vector_Affine3d result;
+  std::size_t anchor = 0;
+  result.push_back(poses.front());
+  while (anchor < poses.size() - 1)
+  {
+    std::size_t end = anchor + 1;
+    while (end + 1 < poses.size() &&
+           (max_step <= 0.0 || (poses[end + 1].translation() - poses[anchor].translation()).norm() <= max_step) &&
+           within_tolerance(anchor, end + 1))
+    {
+      ++end;
+    }
+    result.push_back(poses[end]);
+    anchor = end;
+  }
+  return result;
+}
+
 std::vector<godel_process_planning::ConnectingPath>
 godel_process_planning::generateTransitions(const std::vector<geometry_msgs::PoseArray> &segments,
                                             const TransitionParameters& params)
 {
+  const bool part_known = params.part && !params.part->empty();
   auto traverse_height = params.traverse_height;
-  if (traverse_height < 0.1)
+  if (!part_known && traverse_height < 0.1)
   {
     ROS_WARN("Forcing traverse height to at least 0.1m to protect against broken configurations "
              "user requested height = %f.", traverse_height);
     traverse_height = 0.1;
   }
-  std::vector<ConnectingPath> result;
 
-  for (std::size_t i = 0; i < segments.size(); ++i)
+  // Height of the hop that clears the part between two points; the tool is kept this far from its columns.
+  // A traverse height set by the user stays a floor, the part only ever raises the hop above it.
+  const static double PART_CORRIDOR_RADIUS = 0.05; // meters
+  auto hop_height = [&params, part_known, traverse_height](const Eigen::Affine3d& from, const Eigen::Affine3d& to)
   {
-    // First we extract the initial and final position of the path segment
-    const auto& start_pose = segments[i].poses.front(); // First point in this segment
-    const auto& end_pose = segments[i].poses.back();    // Last point in this segment
+    if (!part_known)
+    {
+      return traverse_height;
+    }
+    const double top = params.part->maxHeight(from.translation(), to.translation(), PART_CORRIDOR_RADIUS);
+    const double hop = std::max(top, std::min(from.translation().z(), to.translation().z())) + params.part_clearance;
+    return params.traverse_height > 0.0 ? std::max(hop, params.traverse_height) : hop;
+  };
 
+  std::vector<Eigen::Affine3d, Eigen::aligned_allocator<Eigen::Affine3d>> starts, ends;
+  for (const auto& segment : segments)
+  {
     Eigen::Affine3d e_start, e_end;
-    tf::poseMsgToEigen(start_pose, e_start);
-    tf::poseMsgToEigen(end_pose, e_end);
+    tf::poseMsgToEigen(segment.poses.front(), e_start); // First point in this segment
+    tf::poseMsgToEigen(segment.poses.back(), e_end);    // Last point in this segment
+    starts.push_back(e_start);
+    ends.push_back(e_end);
+  }
+
+  std::vector<ConnectingPath> result;
+
+  for (std::size_t i = 0; i < segments.size(); ++i)
+  {
+    // The depart of one segment and the approach of the next share a height, so the move between them is level
+    const double approach_height = i == 0 ? hop_height(starts[i], starts[i]) : hop_height(ends[i - 1], starts[i]);
+    const double depart_height =
+        i == segments.size() - 1 ? hop_height(ends[i], ends[i]) : hop_height(ends[i], starts[i + 1]);
 
     // Now we want to generate our intermediate waypoints
-    auto approach = retractPath(e_start, params.retract_dist,traverse_height, params.linear_disc,
+    auto approach = retractPath(starts[i], params.retract_dist, approach_height, params.linear_disc,
                                 params.angular_disc);
-    auto depart = retractPath(e_end, params.retract_dist, traverse_height, params.linear_disc,
+    auto depart = retractPath(ends[i], params.retract_dist, depart_height, params.linear_disc,
                               params.angular_disc);
     std::reverse(approach.begin(), approach.end()); // we flip the 'to' path to keep the time ordering of the path
 
@@ -142,7 +225,8 @@ using DescartesConversionFunc =
 godel_process_planning::DescartesTraj
 godel_process_planning::toDescartesTraj(const std::vector<geometry_msgs::PoseArray> &segments,
                                         const double process_speed, const TransitionParameters& transition_params,
-                                        DescartesConversionFunc conversion_fn)
+                                        DescartesConversionFunc conversion_fn,
+                                        std::vector<SegmentRange>* segment_ranges)
 {
   auto transitions = generateTransitions(segments, transition_params);
 
@@ -152,20 +236,41 @@ godel_process_planning::toDescartesTraj(const std::vector<geometry_msgs::PoseArr
   // Convert pose arrays to Eigen types
   auto eigen_segments = toEigenArrays(segments);
 
-  // Inline function for adding a sequence of motions
-  auto add_segment = [&traj, &last_pose, process_speed, conversion_fn, transition_params]
-                     (const EigenSTL::vector_Affine3d& poses, bool free_last)
+  if (segment_ranges)
+  {
+    segment_ranges->clear();
+  }
+
+  // Inline function for adding a sequence of motions, returns the index of the point at the first pose
+  auto add_segment = [&traj, &last_pose, conversion_fn, transition_params]
+                     (const EigenSTL::vector_Affine3d& dense_poses, double speed, bool free_last)
   {
+    std::size_t first = traj.size();
+    EigenSTL::vector_Affine3d nominal_poses;
+    nominal_poses.reserve(dense_poses.size());
+    for (const auto& pose : dense_poses)
+    {
+      nominal_poses.push_back(createNominalTransform(pose, transition_params.z_adjust));
+    }
+    // Straight runs collapse to a few points, keeping the graph small where Descartes has nothing to decide
+    const auto poses = thinPath(nominal_poses, transition_params.chordal_tol, transition_params.angular_tol,
+                                transition_params.max_disc);
+
     // Create Descartes trajectory for the segment path
     for (std::size_t j = 0; j < poses.size(); ++j)
     {
-      Eigen::Affine3d this_pose = createNominalTransform(poses[j], transition_params.z_adjust);
+      const Eigen::Affine3d& this_pose = poses[j];
       // O(1) jerky - may need to revisit this time parameterization later. This at least allows
       // Descartes to perform some optimizations in its graph serach.
-      double dt = (this_pose.translation() - last_pose.translation()).norm() / process_speed;
+      double dt = (this_pose.translation() - last_pose.translation()).norm() / speed;
 
       if (dt < 1e-4)
       {
+        // the first pose coincides with the last point added, e.g. the end of an approach
+        if (j == 0 && !traj.empty())
+        {
+          first = traj.size() - 1;
+        }
         continue;
       }
 
@@ -176,25 +281,30 @@ godel_process_planning::toDescartesTraj(const std::vector<geometry_msgs::PoseArr
       traj.push_back( conversion_fn(this_pose, dt) );
       last_pose = this_pose;
     }
+    return first;
   };
 
   for (std::size_t i = 0; i < segments.size(); ++i)
   {
-    add_segment(transitions[i].approach, false);
+    add_segment(transitions[i].approach, transition_params.traverse_speed, false);
 
-    add_segment(eigen_segments[i], false);
+    const std::size_t first = add_segment(eigen_segments[i], process_speed, false);
+    if (segment_ranges && !traj.empty())
+    {
+      segment_ranges->push_back(SegmentRange(std::min(first, traj.size() - 1), traj.size() - 1));
+    }
 
-    add_segment(transitions[i].depart, false);
+    add_segment(transitions[i].depart, transition_params.traverse_speed, false);
 
     if (i != segments.size() - 1)
     {
-      // To keep the robot at a safe height while we have no model of the parts we're working on, this code enforces a
-      // linear travel between poses. The call to closestRotationalPose allows the linear interpolation to happen to the
+      // To keep the robot at a safe height over the part (or the fixed traverse height when we have no model of it),
+      // this code enforces a linear travel between poses. The call to closestRotationalPose allows the linear interpolation to happen to the
       // pose that is 180 degrees off (about Z) from the nominal one. The discretization in Descartes takes care of the rest.
       auto connection = interpolateCartesian(transitions[i].depart.back(),
                                              closestRotationalPose(transitions[i].depart.back(), transitions[i+1].approach.front()),
                                              transition_params.linear_disc, transition_params.angular_disc);
-      add_segment(connection, false);
+      add_segment(connection, transition_params.traverse_speed, false);
     }
   } // end segments
 
@@ -2,6 +2,7 @@
 #define GODEL_PROCESS_PLANNING_PATH_TRANSITIONS_H
 
 #include "common_utils.h"
+#include "part_height_map.h"
 #include <godel_msgs/BlendingPlanParameters.h>
 #include "eigen_conversions/eigen_msg.h"
 
@@ -19,18 +20,31 @@ struct TransitionParameters
 {
   double linear_disc;
   double angular_disc;
+  double chordal_tol;  // (m) points closer than this to the chord between their neighbors are dropped, 0 keeps all
+  double angular_tol;  // (rad) ...as long as their orientation is also within this of the interpolated one
+  double max_disc;     // (m) upper bound on the distance between points that survive the thinning, 0 for none
   double traverse_height;
   double retract_dist;
   double z_adjust;
+  double traverse_speed; // (m/s) speed of the approach, depart and connecting moves
+  // Scanned part, if known; transitions then hop part_clearance over it, but never below a positive traverse_height
+  const PartHeightMap* part = nullptr;
+  double part_clearance = 0.0; // (m)
 };
 
+/**
+ * @brief Indices [first, last] of the Descartes points that belong to one process segment
+ */
+typedef std::pair<std::size_t, std::size_t> SegmentRange;
+
 std::vector<ConnectingPath> generateTransitions(const std::vector<geometry_msgs::PoseArray>& segments,
                                                 const TransitionParameters& params);
 
 /**
  * @brief transforms a sequence of pose-arrays, each representing a single 'segment' of a
  * process path into a Descartes specific format. This function also adds transitions between
- * segments.
+ * segments. Every sequence of poses is thinned so that points are only kept where the path
+ * curves or turns by more than the chordal and angular tolerances of \e transition_params.
  * @param segments Sequence of poses (relative to the world space of blending robot model)
  * @param traverse_height The height in meters from the surface of the part to move to before
  *        moving to the next segment start
@@ -38,12 +52,14 @@ std::vector<ConnectingPath> generateTransitions(const std::vector<geometry_msgs:
  * @param linear_discretization The distance (meters) between points in the connecting paths
  * @param conversion_fn A function that creates a Descartes process point of whatever type your
  *        process (e.g. blending or scanning) requires
+ * @param segment_ranges If given, filled with the range of the returned points covering each segment
  * @return The input trajectory encoded in Descartes points
  */
 godel_process_planning::DescartesTraj
 toDescartesTraj(const std::vector<geometry_msgs::PoseArray>& segments,
                 const double process_speed, const TransitionParameters& transition_params,
-                boost::function<descartes_core::TrajectoryPtPtr(const Eigen::Affine3d&, const double)> conversion_fn);
+                boost::function<descartes_core::TrajectoryPtPtr(const Eigen::Affine3d&, const double)> conversion_fn,
+                std::vector<SegmentRange>* segment_ranges = nullptr);
 
 
 }
@@ -5,10 +5,13 @@
 #include <ros/service_server.h>
 #include <trajectory_msgs/JointTrajectory.h>
 #include "abb_file_suite/ExecuteProgram.h"
+#include <boost/scoped_ptr.hpp>
 
 namespace abb_file_suite
 {
 
+class FtpSession;
+
 /**
  * @brief The class provides an alternative driver interface to ABB robots
  *        running an FTP server. It offers a joint trajectory interface and
@@ -20,20 +23,22 @@ public:
   AbbMotionFtpDownloader(const std::string& ip, const std::string& listen_topic,
                          ros::NodeHandle& nh,
                          const std::string& ftp_user, const std::string& ftp_pass,
-                         bool j23_coupled = false,
-                         const std::string& temp_file_loc = std::string("/tmp"));
+                         bool j23_coupled = false);
+  ~AbbMotionFtpDownloader();
 
   /**
    * Callback handler that executes a new joint trajectory. This is accomplished
-   * by writing a RAPID file that encodes the requested joint motions and timing.
-   * This file is then uploaded via FTP
+   * by generating a RAPID module in memory that encodes the requested joint motions
+   * and timing. The module is then uploaded via FTP
    */
   void handleJointTrajectory(const trajectory_msgs::JointTrajectory& traj);
 
   /**
-   * This service call handler will attempt to directly upload a RAPID file
-   * to the robot from the path given in the request.
-   * @param  req Contains the ABSOLUTE path the RAPID file to upload
+   * This service call handler will attempt to directly upload a RAPID module
+   * to the robot, either the text given in the request or the file at its path.
+   * Modules given a name are kept on the controller, so later requests may run
+   * them by name alone.
+   * @param  req Contains the RAPID module text, or the ABSOLUTE path to the RAPID file to upload
    * @param  res No fields in the return value
    * @return     True if the FTP transfer was completed; note this doesn't mean the robot
    *             succeeded or even read the complete file.
@@ -44,10 +49,7 @@ public:
 private:
   ros::Subscriber trajectory_sub_;
   ros::ServiceServer server_;
-  const std::string ip_;
-  const std::string temp_file_loc_;
-  const std::string user_;
-  const std::string pwd_;
+  boost::scoped_ptr<FtpSession> session_; /** kept open between uploads */
   bool j23_coupled_; /** joints 2 and 3 are coupled (as in ABB IRB2400) */
 };
 }
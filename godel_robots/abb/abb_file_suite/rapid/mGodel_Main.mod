@@ -1,17 +1,51 @@
 MODULE mGodel_DemoMain
+    ! Modules kept on the controller, named by the hash of their contents
+    CONST string CACHE_DIR := "HOME:/PARTMODULES/cache";
+    ! Written to request a run of a cached module; holds the module's file name
+    CONST string RUN_FILE := "HOME:/PARTMODULES/mGodelRun.txt";
+
+    VAR iodev run_file;
+    VAR string module_name;
+    ! Cached module currently loaded, so a repeated run needs no load at all
+    VAR string loaded_name := "";
+
     PROC Godel_Main()
         !Delete Files if they exist
         IF IsFile("HOME:/PARTMODULES/mGodelBlend.mod") RemoveFile "HOME:/PARTMODULES/mGodelBlend.mod";
+        IF IsFile(RUN_FILE) RemoveFile RUN_FILE;
         IF ModExist("mGodel_Blend") EraseModule("mGodel_Blend");
+        loaded_name := "";
         
         WHILE true DO
-          !Wait for Blend File
-          WaitUntil IsFile("HOME:/PARTMODULES/mGodelBlend.mod");
+          !Wait for Blend File or a request to run a cached module
+          WaitUntil IsFile("HOME:/PARTMODULES/mGodelBlend.mod") OR IsFile(RUN_FILE);
           WaitTime 0.25;
-          Load "HOME:/PartModules" \File:="mGodelBlend.MOD";
-          %"Godel_Blend"%;
-          UnLoad "HOME:/PartModules" \File:="mGodelBlend.MOD";
-          RemoveFile "HOME:/PARTMODULES/mGodelBlend.mod";
+          IF IsFile("HOME:/PARTMODULES/mGodelBlend.mod") THEN
+            !Both define mGodel_Blend, so the cached module has to go first
+            IF loaded_name <> "" THEN
+              UnLoad CACHE_DIR \File:=loaded_name;
+              loaded_name := "";
+            ENDIF
+            Load "HOME:/PartModules" \File:="mGodelBlend.MOD";
+            %"Godel_Blend"%;
+            UnLoad "HOME:/PartModules" \File:="mGodelBlend.MOD";
+            RemoveFile "HOME:/PARTMODULES/mGodelBlend.mod";
+          ELSE
+            Open RUN_FILE, run_file \Read;
+            module_name := ReadStr(run_file);
+            Close run_file;
+            RemoveFile RUN_FILE;
+            IF module_name <> loaded_name THEN
+              IF loaded_name <> "" UnLoad CACHE_DIR \File:=loaded_name;
+              loaded_name := "";
+              IF IsFile(CACHE_DIR + "/" + module_name) THEN
+                Load CACHE_DIR \File:=module_name;
+                loaded_name := module_name;
+              ENDIF
+            ENDIF
+            !A module missing from the cache is not run; the host times out and uploads it again
+            IF loaded_name <> "" %"Godel_Blend"%;
+          ENDIF
         ENDWHILE
         !
     ENDPROC
@@ -1,6 +1,7 @@
 #include "abb_file_suite/abb_motion_ftp_downloader.h"
 
 #include <fstream>
+#include <sstream>
 
 #include <ros/ros.h>
 
@@ -9,7 +10,11 @@
 
 // Constants
 const static std::string EXECUTE_PROGRAM_SERVICE_NAME = "execute_program";
-const static std::string RAPID_MODULE_NAME = "mGodel_blend.mod";
+const static std::string RAPID_MODULE_NAME = "mGodelBlend.mod";
+const static std::string REMOTE_MODULE_DIR = "/PARTMODULES";
+// Relative to REMOTE_MODULE_DIR; must match mGodel_Main.mod
+const static std::string CACHED_MODULE_DIR = "cache/";
+const static std::string RUN_REQUEST_NAME = "mGodelRun.txt";
 
 // Utility functions
 static double toDegrees(const double radians) { return radians * 180.0 / M_PI; }
@@ -25,30 +30,13 @@ static std::vector<double> toDegrees(const std::vector<double>& radians)
 
 static void linkageAdjust(std::vector<double>& joints) { joints[2] += joints[1]; }
 
-/**
- * Joins a directory and filename while being independent to whether the user
- * added a trailing slash or not.
- *
- * @param  dir      absolute path to directory
- * @param  filename file name
- * @return          absolute path to file
- */
-static std::string fileJoin(const std::string& dir, const std::string& filename)
-{
-  if (dir[dir.length() - 1] == '/')
-    return (dir + filename);
-  else
-    return (dir + std::string("/") + filename);
-}
-
 abb_file_suite::AbbMotionFtpDownloader::AbbMotionFtpDownloader(const std::string& ip,
                                                                const std::string& listen_topic,
                                                                ros::NodeHandle& nh,
                                                                const std::string& ftp_user, 
                                                                const std::string& ftp_pass,
-                                                               bool j23_coupled,
-                                                               const std::string& temp_file_loc)
-    : ip_(ip), temp_file_loc_(temp_file_loc), user_(ftp_user), pwd_(ftp_pass), j23_coupled_(j23_coupled)
+                                                               bool j23_coupled)
+    : session_(new FtpSession(ip + REMOTE_MODULE_DIR, ftp_user, ftp_pass)), j23_coupled_(j23_coupled)
 {
   trajectory_sub_ =
       nh.subscribe(listen_topic, 10, &AbbMotionFtpDownloader::handleJointTrajectory, this);
@@ -57,20 +45,11 @@ abb_file_suite::AbbMotionFtpDownloader::AbbMotionFtpDownloader(const std::string
                                 &AbbMotionFtpDownloader::handleServiceCall, this);
 }
 
+abb_file_suite::AbbMotionFtpDownloader::~AbbMotionFtpDownloader() {}
+
 void abb_file_suite::AbbMotionFtpDownloader::handleJointTrajectory(
     const trajectory_msgs::JointTrajectory& traj)
 {
-  // Create temporary file
-  const std::string temp_file_path = fileJoin(temp_file_loc_, RAPID_MODULE_NAME);
-  // generate temporary file with appropriate rapid code
-  std::ofstream ofh(temp_file_path.c_str());
-
-  if (!ofh)
-  {
-    ROS_WARN_STREAM("Could not create file: " << temp_file_path);
-    return;
-  }
-
   std::vector<rapid_emitter::TrajectoryPt> pts;
   pts.reserve(traj.points.size());
   for (std::size_t i = 0; i < traj.points.size(); ++i)
@@ -92,12 +71,12 @@ void abb_file_suite::AbbMotionFtpDownloader::handleJointTrajectory(
 
   rapid_emitter::ProcessParams params;
   params.wolf_mode = false;
-  rapid_emitter::emitJointTrajectoryFile(ofh, pts, params);
-  ofh.flush();
-  ofh.close();
+  // generate the module with appropriate rapid code in memory
+  std::ostringstream module;
+  rapid_emitter::emitJointTrajectoryFile(module, pts, params);
 
   // send to controller
-  if (!uploadFile(ip_ + "/PARTMODULES", temp_file_path, user_, pwd_))
+  if (!session_->upload(RAPID_MODULE_NAME, module.str()))
   {
     ROS_WARN("Could not upload joint trajectory to remote ftp server");
   }
@@ -106,14 +85,29 @@ void abb_file_suite::AbbMotionFtpDownloader::handleJointTrajectory(
 bool abb_file_suite::AbbMotionFtpDownloader::handleServiceCall(
     abb_file_suite::ExecuteProgram::Request& req, abb_file_suite::ExecuteProgram::Response& res)
 {
-  // Check for existence
-  std::ifstream ifh(req.file_path.c_str());
+  if (!req.module_name.empty())
+  {
+    // Store the module if it is new, then ask the controller to run it by name
+    if (!req.program.empty() && !session_->upload(CACHED_MODULE_DIR + req.module_name, req.program))
+    {
+      return false;
+    }
+    return session_->upload(RUN_REQUEST_NAME, req.module_name);
+  }
+
+  if (!req.program.empty())
+  {
+    return session_->upload(RAPID_MODULE_NAME, req.program);
+  }
+
+  std::ifstream ifh(req.file_path.c_str(), std::ios::binary);
   if (!ifh)
   {
     ROS_WARN("Could not open file '%s'.", req.file_path.c_str());
     return false;
   }
-  ifh.close();
 
-  return uploadFile(ip_ + "/PARTMODULES", req.file_path.c_str(),  user_, pwd_);
+  std::ostringstream contents;
+  contents << ifh.rdbuf();
+  return session_->upload(RAPID_MODULE_NAME, contents.str());
 }
@@ -1,6 +1,6 @@
 #include "ftp_upload.h"
 
-#include <stdlib.h>
+#include <string.h>
 #include <stdio.h>
 
 #include <curl/curl.h>
@@ -12,6 +12,14 @@
 
 const static long DEFAULT_TIMEOUT = 0; // Don't timeout
 const static long DEFAULT_RETRIES = 5;
+const static long KEEP_ALIVE_IDLE = 60; // seconds before the first keep-alive probe
+
+/* an upload in progress: the module text and how much of it has been sent */
+struct UploadSource
+{
+  const std::string* contents;
+  size_t offset;
+};
 
 /* parse headers for Content-Length */
 static size_t getcontentlengthfunc(void* ptr, size_t size, size_t nmemb, void* stream)
@@ -37,56 +45,41 @@ static size_t discardfunc(void* ptr, size_t size, size_t nmemb, void* stream)
 /* read data to upload */
 static size_t readfunc(void* ptr, size_t size, size_t nmemb, void* stream)
 {
-  FILE* f = static_cast<FILE*>(stream);
-  size_t n;
+  UploadSource* src = static_cast<UploadSource*>(stream);
 
-  if (ferror(f))
-    return CURL_READFUNC_ABORT;
+  size_t n = src->contents->size() - src->offset;
+  if (n > size * nmemb)
+    n = size * nmemb;
 
-  n = fread(ptr, size, nmemb, f) * size;
+  memcpy(ptr, src->contents->data() + src->offset, n);
+  src->offset += n;
 
   return n;
 }
 
-static int upload(CURL* curlhandle, const char* remotepath, const char* localpath, long timeout,
-                  long tries, const char* user_and_pwd)
+static int uploadContents(CURL* curlhandle, const char* remotepath, const std::string& contents, long timeout,
+                          long tries)
 {
-  FILE* f;
   long uploaded_len = 0;
   CURLcode r = CURLE_GOT_NOTHING;
   int c;
 
-  f = fopen(localpath, "rb");
-  if (f == NULL)
-  {
-    perror(NULL);
-    return 0;
-  }
+  UploadSource src;
+  src.contents = &contents;
+  src.offset = 0;
 
   curl_easy_setopt(curlhandle, CURLOPT_UPLOAD, 1L);
 
   curl_easy_setopt(curlhandle, CURLOPT_URL, remotepath);
 
-  if (user_and_pwd)
-    curl_easy_setopt(curlhandle, CURLOPT_USERPWD, user_and_pwd); //"Default User:robotics" by default
-
-  curl_easy_setopt(curlhandle, CURLOPT_CONNECTTIMEOUT, 2L);
+  curl_easy_setopt(curlhandle, CURLOPT_INFILESIZE_LARGE, static_cast<curl_off_t>(contents.size()));
 
   if (timeout)
     curl_easy_setopt(curlhandle, CURLOPT_FTP_RESPONSE_TIMEOUT, timeout);
 
-  curl_easy_setopt(curlhandle, CURLOPT_HEADERFUNCTION, getcontentlengthfunc);
   curl_easy_setopt(curlhandle, CURLOPT_HEADERDATA, &uploaded_len);
 
-  curl_easy_setopt(curlhandle, CURLOPT_WRITEFUNCTION, discardfunc);
-
-  curl_easy_setopt(curlhandle, CURLOPT_READFUNCTION, readfunc);
-  curl_easy_setopt(curlhandle, CURLOPT_READDATA, f);
-
-  curl_easy_setopt(curlhandle, CURLOPT_FTPPORT, "-"); /* disable passive mode */
-  curl_easy_setopt(curlhandle, CURLOPT_FTP_CREATE_MISSING_DIRS, 1L);
-
-  curl_easy_setopt(curlhandle, CURLOPT_VERBOSE, 1L);
+  curl_easy_setopt(curlhandle, CURLOPT_READDATA, &src);
 
   for (c = 0; (r != CURLE_OK) && (c < tries); c++)
   {
@@ -113,7 +106,9 @@ static int upload(CURL* curlhandle, const char* remotepath, const char* localpat
       curl_easy_setopt(curlhandle, CURLOPT_NOBODY, 0L);
       curl_easy_setopt(curlhandle, CURLOPT_HEADER, 0L);
 
-      fseek(f, uploaded_len, SEEK_SET);
+      src.offset = static_cast<size_t>(uploaded_len);
+      if (src.offset > contents.size())
+        src.offset = contents.size();
 
       curl_easy_setopt(curlhandle, CURLOPT_APPEND, 1L);
     }
@@ -125,7 +120,12 @@ static int upload(CURL* curlhandle, const char* remotepath, const char* localpat
     r = curl_easy_perform(curlhandle);
   }
 
-  fclose(f);
+  /* leave the handle ready for the next upload of the session */
+  curl_easy_setopt(curlhandle, CURLOPT_NOBODY, 0L);
+  curl_easy_setopt(curlhandle, CURLOPT_HEADER, 0L);
+  curl_easy_setopt(curlhandle, CURLOPT_APPEND, 0L);
+  curl_easy_setopt(curlhandle, CURLOPT_READDATA, NULL);
+  curl_easy_setopt(curlhandle, CURLOPT_HEADERDATA, NULL);
 
   if (r == CURLE_OK)
     return 1;
@@ -136,29 +136,57 @@ static int upload(CURL* curlhandle, const char* remotepath, const char* localpat
   }
 }
 
-bool abb_file_suite::uploadFile(const std::string& ftp_addr, const std::string& filepath,
-                                const std::string& user_name, const std::string& password)
+abb_file_suite::FtpSession::FtpSession(const std::string& ftp_addr, const std::string& user_name,
+                                       const std::string& password)
+  : handle_(NULL), ftp_addr_(ftp_addr)
 {
-  CURL* curlhandle = NULL;
-
+  // Calls to curl_global_init are counted, so every session may pair one with its cleanup
   curl_global_init(CURL_GLOBAL_ALL);
-  curlhandle = curl_easy_init();
+  CURL* curlhandle = curl_easy_init();
+  handle_ = curlhandle;
 
-  std::string to = "ftp://" + ftp_addr + "/mGodelBlend.mod";
+  if (!curlhandle)
+    return;
 
-  std::string user_pwd = user_name + ":" + password;
-
-  const char* auth_string = NULL;
   if (!user_name.empty() && !password.empty())
   {
-    auth_string = user_pwd.c_str();
+    user_pwd_ = user_name + ":" + password;
+    curl_easy_setopt(curlhandle, CURLOPT_USERPWD, user_pwd_.c_str()); //"Default User:robotics" by default
   }
 
-  bool result = upload(curlhandle, to.c_str(), filepath.c_str(), DEFAULT_TIMEOUT, DEFAULT_RETRIES,
-                       auth_string);
+  curl_easy_setopt(curlhandle, CURLOPT_CONNECTTIMEOUT, 2L);
 
-  curl_easy_cleanup(curlhandle);
+  /* the control connection stays open between uploads; probe it so an idle session is not dropped */
+  curl_easy_setopt(curlhandle, CURLOPT_TCP_KEEPALIVE, 1L);
+  curl_easy_setopt(curlhandle, CURLOPT_TCP_KEEPIDLE, KEEP_ALIVE_IDLE);
+  curl_easy_setopt(curlhandle, CURLOPT_TCP_KEEPINTVL, KEEP_ALIVE_IDLE);
+
+  curl_easy_setopt(curlhandle, CURLOPT_HEADERFUNCTION, getcontentlengthfunc);
+  curl_easy_setopt(curlhandle, CURLOPT_WRITEFUNCTION, discardfunc);
+  curl_easy_setopt(curlhandle, CURLOPT_READFUNCTION, readfunc);
+
+  curl_easy_setopt(curlhandle, CURLOPT_FTPPORT, "-"); /* disable passive mode */
+  curl_easy_setopt(curlhandle, CURLOPT_FTP_CREATE_MISSING_DIRS, 1L);
+
+  curl_easy_setopt(curlhandle, CURLOPT_VERBOSE, 1L);
+}
+
+abb_file_suite::FtpSession::~FtpSession()
+{
+  if (handle_)
+    curl_easy_cleanup(static_cast<CURL*>(handle_));
   curl_global_cleanup();
+}
+
+bool abb_file_suite::FtpSession::upload(const std::string& remote_name, const std::string& contents)
+{
+  if (!handle_)
+  {
+    fprintf(stderr, "FTP session to %s could not be initialized\n", ftp_addr_.c_str());
+    return false;
+  }
+
+  std::string to = "ftp://" + ftp_addr_ + "/" + remote_name;
 
-  return result;
+  return uploadContents(static_cast<CURL*>(handle_), to.c_str(), contents, DEFAULT_TIMEOUT, DEFAULT_RETRIES);
 }
@@ -6,8 +6,32 @@
 namespace abb_file_suite
 {
 
-bool uploadFile(const std::string& ftp_addr, const std::string& filepath,
-                const std::string& user_name, const std::string& password);
+/**
+ * @brief A curl FTP handle that is kept between uploads, so that the control connection and login
+ *        to the controller are reused rather than set up again for every module. Not thread safe;
+ *        use one session per thread.
+ */
+class FtpSession
+{
+public:
+  FtpSession(const std::string& ftp_addr, const std::string& user_name, const std::string& password);
+  ~FtpSession();
+
+  /**
+   * @brief Uploads 'contents' as the file 'remote_name' in the directory given by the session's address.
+   *        Interrupted transfers are resumed, reconnecting if the controller dropped the session.
+   * @return True if the transfer completed
+   */
+  bool upload(const std::string& remote_name, const std::string& contents);
+
+private:
+  FtpSession(const FtpSession&);
+  FtpSession& operator=(const FtpSession&);
+
+  void* handle_; // CURL*
+  std::string ftp_addr_;
+  std::string user_pwd_;
+};
 }
 
 #endif // FTP_UPLOAD_H
@@ -2,6 +2,16 @@
 #define KEYENCE_SCAN_SERVER_H
 
 #include <string>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/lockfree/queue.hpp>
 
 // scan type
 #include <pcl_ros/point_cloud.h>
@@ -23,10 +33,18 @@ struct ScanServerConfig
   std::string scan_frame;
   double voxel_grid_leaf_size;
   double voxel_grid_publish_period;
+  int analysis_threads;     // scoring workers
+  int intake_capacity;      // profiles waiting for a worker before new ones are dropped
+  double metrics_period;    // seconds between pipeline diagnostics
 };
 
 /**
  * Defines the ROS interface for a surface-quality-map
+ *
+ * Profiles pass through a pipeline so the subscriber never waits on analysis: the callback only numbers
+ * each profile and pushes it on a lock-free intake queue; a pool of workers scores them; a resolver
+ * thread transforms the scored profiles in batches, once the robot pose at their stamps is known, and
+ * merges them into the map in the order the profiles arrived.
  */
 class ScanServer
 {
@@ -35,20 +53,26 @@ public:
   typedef pcl::PointCloud<pcl::PointXYZ> Cloud;
 
   ScanServer(const ScanServerConfig& config);
+  ~ScanServer();
 
   /**
-   * Analyzes the passed-in cloud and adds the scored points to the internal map
+   * Queues the passed-in cloud for analysis; its scored points are added to the internal map
    */
-  void scanCallback(const Cloud& cloud);
+  void scanCallback(const Cloud::ConstPtr& cloud);
 
   /**
    * A debug call-back to publish point-clouds meant for ROS
    */
   void publishCloud(const ros::TimerEvent&) const;
 
+  /**
+   * Publishes counters of the pipeline stages to /diagnostics, so lost or dropped profiles show up
+   */
+  void publishMetrics(const ros::TimerEvent&);
+
   /**
    * Queries the underlying map for a colorized point cloud representing the current surface quality
-   * of the system
+   * of the system. The map keeps growing while profiles are merged.
    * @return Shared-Pointer to const PointCloud<PointXYZRGB>
    */
   ColorCloud::ConstPtr getSurfaceQuality() const { return map_; }
@@ -59,20 +83,85 @@ public:
   void clear();
 
 private:
-  void transformScan(ColorCloud& cloud, const ros::Time& tm) const;
-  tf::StampedTransform findTransform(const ros::Time& tm) const;
+  // A profile on its way through the pipeline; 'sequence' orders the merge
+  struct Profile
+  {
+    std::uint64_t sequence;
+    Cloud::ConstPtr cloud;
+  };
+
+  // A scored profile waiting for the robot pose at 'stamp'; 'cloud' is null if scoring rejected it
+  struct ScoredProfile
+  {
+    ColorCloud::Ptr cloud;
+    ros::Time stamp;
+    ros::WallTime scored;
+  };
+
+  enum PoseStatus
+  {
+    POSE_READY,
+    POSE_PENDING,    // the robot has not been seen at the stamp yet
+    POSE_UNAVAILABLE // older than the buffered poses and unknown to tf, or waited too long
+  };
+
+  void analysisWorker();
+  // Hands in the result for 'sequence' to wait for its pose and its turn
+  void submit(std::uint64_t sequence, const ScoredProfile& result);
+
+  void resolver();
+  // Appends the newest world->scan transform known to tf, without waiting for one
+  void samplePose();
+  // Transforms and merges, in order, every waiting profile whose pose is known
+  void resolvePending();
+  PoseStatus findTransform(const ros::Time& tm, const ros::WallTime& scored, tf::Transform& transform) const;
 
   RoughnessScorer scorer_; /** Object that scores individual lines */
   ColorCloud::Ptr map_;    /** Data structure that contains colorised surface quality results */
-  ColorCloud::Ptr buffer_; /** Temporarily holds scan results for post-processing and tf lookup */
   tf::TransformListener
       tf_listener_;          // for looking up transforms between laser scan and arm position
   ros::Subscriber scan_sub_; // for listening to scans
   ros::Publisher cloud_pub_; // for outputting colored clouds of data
+  ros::Publisher metrics_pub_;
   ros::Timer timer_;         // Publish timer for color cloud
+  ros::Timer metrics_timer_;
   std::string from_frame_;   // typically laser_scan_frame
   std::string to_frame_;     // typically world_frame
   ScanServerConfig config_;
+
+  // Intake: filled by the subscriber, drained by the workers
+  boost::lockfree::queue<Profile*> intake_;
+  std::mutex intake_mutex_; // only serves the condition variable that wakes idle workers
+  std::condition_variable intake_ready_;
+  std::vector<std::thread> workers_;
+  std::atomic<bool> running_;
+
+  mutable std::mutex map_mutex_; // guards map_
+
+  // Merge: scored profiles wait here for their pose, and for their turn if they finished early
+  mutable std::mutex reorder_mutex_; // guards the fields below
+  std::map<std::uint64_t, ScoredProfile> reorder_;
+  std::uint64_t next_merge_;
+
+  // Robot poses, oldest first; only touched by the resolver thread
+  std::deque<tf::StampedTransform> poses_;
+  std::atomic<std::size_t> buffered_poses_;
+  std::thread resolver_;
+  std::mutex resolver_mutex_; // only serves the condition variable that paces the resolver
+  std::condition_variable resolver_wake_;
+
+  // Pipeline counters
+  std::uint64_t next_sequence_;     // subscriber thread only
+  std::uint64_t last_header_seq_;   // subscriber thread only
+  bool have_header_seq_;            // subscriber thread only
+  std::atomic<std::uint64_t> received_;
+  std::atomic<std::uint64_t> lost_upstream_;   // gaps in the header sequence, e.g. subscriber queue overflow
+  std::atomic<std::uint64_t> dropped_intake_;  // intake queue full
+  std::atomic<std::uint64_t> queued_;          // currently on the intake queue
+  std::atomic<std::uint64_t> queued_high_water_;
+  std::atomic<std::uint64_t> rejected_;        // too few valid points to score
+  std::atomic<std::uint64_t> transform_failures_;
+  std::atomic<std::uint64_t> merged_;
 };
 
 } // end namespace godel_scan_analysis
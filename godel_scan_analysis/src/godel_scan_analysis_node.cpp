@@ -2,11 +2,15 @@
 
 #include "godel_scan_analysis/keyence_scan_server.h"
 #include <std_srvs/Trigger.h>
+#include <algorithm>
+#include <thread>
 
 const static std::string DEFAULT_WORLD_FRAME = "world_frame";
 const static std::string DEFAULT_SCAN_FRAME = "keyence_sensor_optical_frame";
 const static double VOXEL_GRID_LEAF_SIZE = 0.005;    // 5 mm
 const static double VOXEL_GRID_PUBLISH_PERIOD = 2.0; // seconds
+const static int INTAKE_CAPACITY = 2000;             // profiles
+const static double METRICS_PERIOD = 1.0;            // seconds
 
 const static std::string DEFAULT_RESET_SERVICE = "reset_scan_server";
 
@@ -35,6 +39,11 @@ int main(int argc, char** argv)
   pnh.param<double>("voxel_leaf_size", config.voxel_grid_leaf_size, VOXEL_GRID_LEAF_SIZE);
   pnh.param<double>("voxel_publish_period", config.voxel_grid_publish_period,
                     VOXEL_GRID_PUBLISH_PERIOD);
+  // By default one core is left to the subscriber and the merge
+  const int cores = static_cast<int>(std::thread::hardware_concurrency());
+  pnh.param<int>("analysis_threads", config.analysis_threads, std::max(cores - 1, 1));
+  pnh.param<int>("intake_capacity", config.intake_capacity, INTAKE_CAPACITY);
+  pnh.param<double>("metrics_period", config.metrics_period, METRICS_PERIOD);
 
   godel_scan_analysis::ScanServer server(config);
 
@@ -2,49 +2,268 @@
 
 #include <pcl_ros/transforms.h>
 #include <pcl/filters/voxel_grid.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
 
 // Constants
-const static double TF_WAIT_TIMEOUT = 0.25; // seconds
+const static std::chrono::milliseconds WORKER_IDLE_WAIT(10); // re-check of the intake by idle workers
+const static std::chrono::milliseconds RESOLVE_PERIOD(10);   // pose sampling and batch resolution
+const static double POSE_BUFFER_DURATION = 10.0; // seconds of robot poses kept for interpolation
+const static double POSE_WAIT_TIMEOUT = 1.0;     // seconds a scored profile may wait for its pose (wall time)
 
 const static std::string COLOR_CLOUD_TOPIC = "color_cloud";
+const static std::string METRICS_TOPIC = "/diagnostics";
+
+template <typename T>
+static void addValue(diagnostic_msgs::DiagnosticStatus& status, const std::string& key, const T& value)
+{
+  std::ostringstream ss;
+  ss << value;
+  diagnostic_msgs::KeyValue kv;
+  kv.key = key;
+  kv.value = ss.str();
+  status.values.push_back(kv);
+}
 
 godel_scan_analysis::ScanServer::ScanServer(const ScanServerConfig& config)
-    : map_(new ColorCloud), buffer_(new ColorCloud), config_(config)
+    : map_(new ColorCloud), config_(config), intake_(std::max(config.intake_capacity, 1)),
+      running_(true), next_merge_(0), buffered_poses_(0), next_sequence_(0), last_header_seq_(0), have_header_seq_(false),
+      received_(0), lost_upstream_(0), dropped_intake_(0), queued_(0), queued_high_water_(0), rejected_(0),
+      transform_failures_(0), merged_(0)
 {
   ros::NodeHandle nh;
+  map_->header.frame_id = config_.world_frame;
+
+  for (int i = 0; i < std::max(config_.analysis_threads, 1); ++i)
+  {
+    workers_.push_back(std::thread(&ScanServer::analysisWorker, this));
+  }
+  resolver_ = std::thread(&ScanServer::resolver, this);
+
   scan_sub_ = nh.subscribe("profiles", 500, &ScanServer::scanCallback, this);
   cloud_pub_ = nh.advertise<ColorCloud>(COLOR_CLOUD_TOPIC, 1);
-  map_->header.frame_id = config_.world_frame;
+  metrics_pub_ = nh.advertise<diagnostic_msgs::DiagnosticArray>(METRICS_TOPIC, 1);
 
   // Create publisher for the collected color cloud
   timer_ = nh.createTimer(ros::Duration(config.voxel_grid_publish_period),
                           &ScanServer::publishCloud, this);
+  metrics_timer_ = nh.createTimer(ros::Duration(config.metrics_period), &ScanServer::publishMetrics, this);
+}
+
+godel_scan_analysis::ScanServer::~ScanServer()
+{
+  scan_sub_.shutdown();
+  {
+    std::lock_guard<std::mutex> lock(intake_mutex_);
+    running_ = false;
+  }
+  intake_ready_.notify_all();
+  for (auto& worker : workers_)
+  {
+    worker.join();
+  }
+  {
+    std::lock_guard<std::mutex> lock(resolver_mutex_);
+  }
+  resolver_wake_.notify_all();
+  resolver_.join();
+
+  Profile* profile;
+  while (intake_.pop(profile))
+  {
+    delete profile;
+  }
+}
+
+void godel_scan_analysis::ScanServer::scanCallback(const Cloud::ConstPtr& cloud)
+{
+  ++received_;
+
+  // Consecutive header sequence numbers mean nothing was lost before this callback; a publisher restart
+  // starts the count over
+  if (have_header_seq_ && cloud->header.seq > last_header_seq_)
+  {
+    lost_upstream_ += cloud->header.seq - last_header_seq_ - 1;
+  }
+  last_header_seq_ = cloud->header.seq;
+  have_header_seq_ = true;
+
+  Profile* profile = new Profile;
+  profile->sequence = next_sequence_;
+  profile->cloud = cloud;
+
+  // Counted before the push so a worker that pops it right away cannot take the depth below zero
+  const std::uint64_t depth = ++queued_;
+  if (!intake_.bounded_push(profile))
+  {
+    --queued_;
+    delete profile;
+    ++dropped_intake_;
+    return;
+  }
+  ++next_sequence_;
+
+  std::uint64_t high = queued_high_water_;
+  while (depth > high && !queued_high_water_.compare_exchange_weak(high, depth))
+  {
+  }
+
+  // Taking the lock orders the push before any idle worker's check, so no wake-up is missed
+  {
+    std::lock_guard<std::mutex> lock(intake_mutex_);
+  }
+  intake_ready_.notify_one();
+}
+
+void godel_scan_analysis::ScanServer::analysisWorker()
+{
+  while (true)
+  {
+    Profile* profile = NULL;
+    if (!intake_.pop(profile))
+    {
+      std::unique_lock<std::mutex> lock(intake_mutex_);
+      if (!running_)
+      {
+        return;
+      }
+      if (intake_.empty())
+      {
+        intake_ready_.wait_for(lock, WORKER_IDLE_WAIT);
+      }
+      continue;
+    }
+    --queued_;
+
+    // Generate colored point cloud of scan data
+    ScoredProfile result;
+    result.cloud.reset(new ColorCloud);
+    if (!scorer_.analyze(*profile->cloud, *result.cloud))
+    {
+      ++rejected_;
+      result.cloud.reset();
+    }
+
+    // Calculate time stamp was processed
+    result.stamp.fromNSec(profile->cloud->header.stamp * 1000);
+    result.scored = ros::WallTime::now();
+
+    submit(profile->sequence, result);
+    delete profile;
+  }
+}
+
+void godel_scan_analysis::ScanServer::submit(std::uint64_t sequence, const ScoredProfile& result)
+{
+  std::lock_guard<std::mutex> lock(reorder_mutex_);
+  reorder_[sequence] = result;
 }
 
-void godel_scan_analysis::ScanServer::scanCallback(const Cloud& cloud)
+void godel_scan_analysis::ScanServer::resolver()
 {
-  // Generate colored point cloud of scan data
-  if (!scorer_.analyze(cloud, *buffer_))
+  std::unique_lock<std::mutex> lock(resolver_mutex_);
+  while (running_)
+  {
+    lock.unlock();
+    samplePose();
+    resolvePending();
+    lock.lock();
+    resolver_wake_.wait_for(lock, RESOLVE_PERIOD);
+  }
+}
+
+void godel_scan_analysis::ScanServer::samplePose()
+{
+  ros::Time latest;
+  std::string error;
+  if (tf_listener_.getLatestCommonTime(config_.world_frame, config_.scan_frame, latest, &error) != 0)
+  {
     return;
+  }
 
-  // Calculate time stamp was processed
-  ros::Time stamp;
-  stamp.fromNSec(cloud.header.stamp * 1000);
+  // A zero stamp means the whole chain is static: one pose then serves every profile
+  if (!poses_.empty() && (latest.isZero() ? poses_.back().stamp_.isZero() : latest <= poses_.back().stamp_))
+  {
+    return;
+  }
 
+  tf::StampedTransform pose;
   try
   {
-    // Transform scan from optical frame to world frame
-    transformScan(*buffer_, stamp);
-    // Insert into results cloud
-    map_->insert(map_->end(), buffer_->begin(), buffer_->end());
+    // Never waits: tf is known to hold this stamp
+    tf_listener_.lookupTransform(config_.world_frame, config_.scan_frame, latest, pose);
   }
   catch (const tf::TransformException& ex)
   {
-    ROS_WARN_STREAM("TF Exception: " << ex.what());
+    ROS_DEBUG_STREAM("TF Exception: " << ex.what());
+    return;
+  }
+
+  if (latest.isZero() || (!poses_.empty() && poses_.back().stamp_.isZero()))
+  {
+    poses_.clear();
+  }
+  poses_.push_back(pose);
+
+  while (poses_.size() > 2 && (latest - poses_.front().stamp_).toSec() > POSE_BUFFER_DURATION)
+  {
+    poses_.pop_front();
+  }
+  buffered_poses_ = poses_.size();
+}
+
+void godel_scan_analysis::ScanServer::resolvePending()
+{
+  // Take the run of profiles that are next in line and whose poses are known
+  std::vector<std::pair<ScoredProfile, tf::Transform> > batch;
+  {
+    std::lock_guard<std::mutex> lock(reorder_mutex_);
+    while (!reorder_.empty() && reorder_.begin()->first == next_merge_)
+    {
+      const ScoredProfile& next = reorder_.begin()->second;
+      tf::Transform transform;
+      if (next.cloud)
+      {
+        const PoseStatus status = findTransform(next.stamp, next.scored, transform);
+        if (status == POSE_PENDING)
+        {
+          break;
+        }
+        if (status == POSE_READY)
+        {
+          batch.push_back(std::make_pair(next, transform));
+        }
+        else
+        {
+          ++transform_failures_;
+        }
+      }
+      reorder_.erase(reorder_.begin());
+      ++next_merge_;
+    }
+  }
+
+  if (batch.empty())
+  {
+    return;
+  }
+
+  // Transform scans from optical frame to world frame; only this thread merges, so order is kept
+  for (auto& entry : batch)
+  {
+    pcl_ros::transformPointCloud(*entry.first.cloud, *entry.first.cloud, entry.second);
   }
 
-  // Reset buffer
-  buffer_->clear();
+  std::lock_guard<std::mutex> lock(map_mutex_);
+  for (const auto& entry : batch)
+  {
+    // Insert into results cloud
+    map_->insert(map_->end(), entry.first.cloud->begin(), entry.first.cloud->end());
+    ++merged_;
+  }
 }
 
 void godel_scan_analysis::ScanServer::publishCloud(const ros::TimerEvent&) const
@@ -52,31 +271,102 @@ void godel_scan_analysis::ScanServer::publishCloud(const ros::TimerEvent&) const
   ColorCloud::Ptr pub_cloud(new ColorCloud);
   // Downsample first
   pcl::VoxelGrid<pcl::PointXYZRGB> vg;
-  vg.setInputCloud(map_);
   vg.setLeafSize(config_.voxel_grid_leaf_size, config_.voxel_grid_leaf_size,
                  config_.voxel_grid_leaf_size);
-  vg.filter(*pub_cloud);
+  {
+    std::lock_guard<std::mutex> lock(map_mutex_);
+    vg.setInputCloud(map_);
+    vg.filter(*pub_cloud);
+  }
 
   cloud_pub_.publish(pub_cloud);
 }
 
-void godel_scan_analysis::ScanServer::clear()
+void godel_scan_analysis::ScanServer::publishMetrics(const ros::TimerEvent&)
 {
-  map_->clear();
+  std::size_t reorder_depth;
+  {
+    std::lock_guard<std::mutex> lock(reorder_mutex_);
+    reorder_depth = reorder_.size();
+  }
+
+  diagnostic_msgs::DiagnosticStatus status;
+  status.name = ros::this_node::getName() + ": scan pipeline";
+  status.hardware_id = config_.scan_frame;
+  const bool losing = lost_upstream_ > 0 || dropped_intake_ > 0;
+  status.level = losing ? diagnostic_msgs::DiagnosticStatus::WARN : diagnostic_msgs::DiagnosticStatus::OK;
+  status.message = losing ? "Profiles were lost" : "No profiles lost";
+
+  addValue(status, "received", received_.load());
+  addValue(status, "lost before intake", lost_upstream_.load());
+  addValue(status, "dropped at intake", dropped_intake_.load());
+  addValue(status, "intake depth", queued_.load());
+  addValue(status, "intake high water", queued_high_water_.load());
+  addValue(status, "intake capacity", config_.intake_capacity);
+  addValue(status, "workers", workers_.size());
+  addValue(status, "rejected by scoring", rejected_.load());
+  addValue(status, "transform failures", transform_failures_.load());
+  addValue(status, "awaiting pose or merge", reorder_depth);
+  addValue(status, "buffered poses", buffered_poses_.load());
+  addValue(status, "merged", merged_.load());
+
+  diagnostic_msgs::DiagnosticArray msg;
+  msg.header.stamp = ros::Time::now();
+  msg.status.push_back(status);
+  metrics_pub_.publish(msg);
 }
 
-void godel_scan_analysis::ScanServer::transformScan(ColorCloud& cloud, const ros::Time& tm) const
+void godel_scan_analysis::ScanServer::clear()
 {
-  tf::StampedTransform transform = findTransform(tm);
-  pcl_ros::transformPointCloud(cloud, cloud, transform);
+  std::lock_guard<std::mutex> lock(map_mutex_);
+  map_->clear();
 }
 
-inline tf::StampedTransform
-godel_scan_analysis::ScanServer::findTransform(const ros::Time& tm) const
+godel_scan_analysis::ScanServer::PoseStatus
+godel_scan_analysis::ScanServer::findTransform(const ros::Time& tm, const ros::WallTime& scored,
+                                               tf::Transform& transform) const
 {
-  tf::StampedTransform transform;
-  tf_listener_.waitForTransform(config_.world_frame, config_.scan_frame, tm,
-                                ros::Duration(TF_WAIT_TIMEOUT));
-  tf_listener_.lookupTransform(config_.world_frame, config_.scan_frame, tm, transform);
-  return transform;
+  if (!poses_.empty() && poses_.back().stamp_.isZero())
+  {
+    transform = poses_.back();
+    return POSE_READY;
+  }
+
+  if (!poses_.empty() && tm >= poses_.front().stamp_ && tm <= poses_.back().stamp_)
+  {
+    // Interpolate between the buffered poses either side of the stamp
+    auto after = std::lower_bound(poses_.begin(), poses_.end(), tm,
+                                  [](const tf::StampedTransform& pose, const ros::Time& t) { return pose.stamp_ < t; });
+    if (after->stamp_ == tm || after == poses_.begin())
+    {
+      transform = *after;
+      return POSE_READY;
+    }
+
+    const tf::StampedTransform& before = *(after - 1);
+    const double ratio = (tm - before.stamp_).toSec() / (after->stamp_ - before.stamp_).toSec();
+    transform.setOrigin(before.getOrigin().lerp(after->getOrigin(), ratio));
+    transform.setRotation(before.getRotation().slerp(after->getRotation(), ratio));
+    return POSE_READY;
+  }
+
+  const bool waited_too_long = (ros::WallTime::now() - scored).toSec() > POSE_WAIT_TIMEOUT;
+  if ((poses_.empty() || tm > poses_.back().stamp_) && !waited_too_long)
+  {
+    return POSE_PENDING;
+  }
+
+  // Older than the buffer (e.g. scanned before the first sample) or never reached: tf may still know it
+  try
+  {
+    tf::StampedTransform stamped;
+    tf_listener_.lookupTransform(config_.world_frame, config_.scan_frame, tm, stamped);
+    transform = stamped;
+    return POSE_READY;
+  }
+  catch (const tf::TransformException& ex)
+  {
+    ROS_WARN_STREAM("TF Exception: " << ex.what());
+    return POSE_UNAVAILABLE;
+  }
 }
@@ -3,6 +3,7 @@
 
 #include <boost/filesystem.hpp>
 
+#include <pcl/PointIndices.h>
 #include <pcl/PolygonMesh.h>
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
@@ -36,6 +37,8 @@ namespace data
       pcl::PointCloud<pcl::PointXYZRGB> input_cloud_;
       pcl::PolygonMesh surface_mesh_;
       pcl::PointCloud<pcl::PointXYZRGB> surface_cloud_;
+      pcl::PointCloud<pcl::Normal> surface_normals_;
+      pcl::PointIndices surface_indices_;
       std::vector<std::pair<std::string, geometry_msgs::PoseArray>> edge_pairs_;
       std::vector<geometry_msgs::PoseArray> blend_poses_;
       std::vector<geometry_msgs::PoseArray> scan_poses_;
@@ -77,6 +80,10 @@ namespace data
     bool getSurfaceName(int id, std::string& name);
     bool setSurfaceMesh(int id, pcl::PolygonMesh mesh);
     bool getSurfaceMesh(int id, pcl::PolygonMesh& mesh);
+    bool setSurfaceNormals(int id, const pcl::PointCloud<pcl::Normal>& normals);
+    bool getSurfaceNormals(int id, pcl::PointCloud<pcl::Normal>& normals);
+    bool setSurfaceIndices(int id, const pcl::PointIndices& indices);
+    bool getSurfaceIndices(int id, pcl::PointIndices& indices);
     bool addEdge(int id, std::string name, geometry_msgs::PoseArray edge_poses);
     bool renameEdge(int id, std::string old_name, std::string new_name);
     bool getEdgePosesByName(const std::string& edge_name, geometry_msgs::PoseArray& edge_poses);
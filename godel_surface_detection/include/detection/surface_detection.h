@@ -23,6 +23,7 @@
 #include <pcl/point_types.h>
 #include <pcl/PolygonMesh.h>
 #include <visualization_msgs/MarkerArray.h>
+#include <moveit_msgs/CollisionObject.h>
 #include <godel_msgs/SurfaceDetectionParameters.h>
 
 #include <random>
@@ -61,6 +62,8 @@ public:
   visualization_msgs::MarkerArray get_surface_markers();
   void get_meshes(std::vector<pcl::PolygonMesh>& meshes);
   void get_surface_clouds(std::vector<CloudRGB::Ptr>& surfaces);
+  void get_surface_normals(std::vector<Normals::Ptr>& normals);
+  void get_surface_indices(std::vector<pcl::PointIndices>& indices);
   void get_full_cloud(CloudRGB& cloud);
   void get_full_cloud(sensor_msgs::PointCloud2 cloud_msg);
   void get_process_cloud(CloudRGB& cloud);
@@ -68,6 +71,10 @@ public:
   void get_region_colored_cloud(CloudRGB& cloud);
   void get_region_colored_cloud(sensor_msgs::PointCloud2& cloud_msg);
 
+  // collision geometry of the part as columns of boxes rising from the lowest point of the process cloud,
+  // suitable for the planning scene; false if there is no process cloud yet
+  bool get_part_collision_object(const std::string& id, moveit_msgs::CollisionObject& object);
+
   std::string getMeshingPluginName() const;
 
 
@@ -86,12 +93,24 @@ private:
   CloudRGB::Ptr process_cloud_ptr_;
   CloudRGB::Ptr region_colored_cloud_ptr_;
   std::vector<CloudRGB::Ptr> surface_clouds_;
+  std::vector<Normals::Ptr> surface_normals_;
+  std::vector<pcl::PointIndices> surface_indices_;
   visualization_msgs::MarkerArray mesh_markers_;
   std::vector<pcl::PolygonMesh> meshes_;
 
   // counter
   int acquired_clouds_counter_;
 
+  // Keys of the inputs that produced the cached process cloud and segmentation results; 0 means no valid result.
+  // find_surfaces() only recomputes a stage whose key changed.
+  std::size_t filter_cache_key_;
+  std::size_t segmentation_cache_key_;
+
+  /**
+   * @brief filterCacheKey hashes the full cloud contents together with every parameter used by filterFullCloud()
+   */
+  std::size_t filterCacheKey() const;
+
   /**
    * @brief filterFullCloud applies a passthrough and voxelgrid filter to the
    * full cloud.  The result of these filters is the process cloud. The
@@ -17,6 +17,7 @@
 #include <ros/ros.h>
 #include <moveit/move_group_interface/move_group_interface.h>
 #include <moveit/robot_trajectory/robot_trajectory.h>
+#include <moveit/planning_scene/planning_scene.h>
 #include <moveit_msgs/DisplayTrajectory.h>
 #include <boost/function.hpp>
 #include <tf/transform_listener.h>
@@ -26,6 +27,10 @@
 #include <sensor_msgs/PointCloud2.h>
 #include <geometry_msgs/PoseArray.h>
 #include <godel_msgs/RobotScanParameters.h>
+#include <boost/circular_buffer.hpp>
+#include <condition_variable>
+#include <map>
+#include <mutex>
 
 #ifndef ROBOT_SCAN_H_
 #define ROBOT_SCAN_H_
@@ -46,6 +51,11 @@ public:
   static const double EEF_STEP;
   static const double MIN_TRAJECTORY_TIME_STEP;
   static const double MIN_JOINT_VELOCITY;
+  static const double SETTLE_SAMPLE_PERIOD;
+  static const double SETTLE_TIMEOUT;
+  static const int CAPTURE_BUFFER_SIZE;
+  static const std::size_t PLAN_CACHE_SIZE;
+  static const double PLAN_CACHE_JOINT_RESOLUTION;
 
 public:
   typedef boost::function<void(pcl::PointCloud<pcl::PointXYZRGB>& cloud)> ScanCallback;
@@ -72,19 +82,67 @@ public:
       unsigned int max_iterations = 200, double max_time_change_per_it = .6);
 
 protected:
+  typedef moveit::planning_interface::MoveGroupInterface::Plan Plan;
+
   // generates circular trajectory above target object
   bool create_scan_trajectory(std::vector<geometry_msgs::Pose>& scan_poses,
                               moveit_msgs::RobotTrajectory& scan_traj);
 
+  // plans a joint space move from 'start' to the scan pose
+  bool plan_to_pose(const moveit::core::RobotState& start, const geometry_msgs::Pose& pose, Plan& plan);
+
+  // replays the plan of an earlier scan for the same parameters, start state and pose if it is still valid in
+  // the current planning scene, plans with plan_to_pose otherwise
+  bool cached_plan_to_pose(const moveit::core::RobotState& start, const geometry_msgs::Pose& pose, Plan& plan);
+
+  std::size_t plan_cache_key(const moveit::core::RobotState& start, const geometry_msgs::Pose& pose) const;
+
+  // fetches the planning scene from move_group, cached plans are checked against it
+  bool update_planning_scene();
+
+  // true if the trajectory is collision free and within limits in the last fetched planning scene
+  bool is_plan_valid(const Plan& plan) const;
+
+  // blocks until no joint moves faster than MIN_JOINT_VELOCITY, returns false on timeout
+  bool wait_for_settle(ros::Time& settle_time);
+
+  // keeps the most recent clouds published on the scan topic
+  void capture_callback(const sensor_msgs::PointCloud2ConstPtr& msg);
+
+  // returns the first buffered cloud stamped after 'after', or a null pointer on timeout
+  sensor_msgs::PointCloud2ConstPtr wait_for_capture(const ros::Time& after, const ros::Duration& timeout);
+
+  // scans from poses of the sweep picked greedily by expected new coverage, see RobotScanParameters
+  int scan_for_coverage();
+
+  // converts, filters and transforms a captured cloud to the scan target frame
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr convert_capture(const sensor_msgs::PointCloud2ConstPtr& msg);
+
+  // converts a captured cloud and hands it to the scan callbacks
+  void process_capture(const sensor_msgs::PointCloud2ConstPtr& msg);
+
 protected:
   // moveit
   MoveGroupPtr move_group_ptr_;
+  // MoveGroupInterface is not thread safe: moves are planned on this instance while move_group_ptr_ executes
+  MoveGroupPtr planning_group_ptr_;
   TransformListenerPtr tf_listener_ptr_;
   std::vector<geometry_msgs::Pose> scan_traj_poses_;
 
   // scan
   std::vector<ScanCallback> callback_list_;
 
+  // plans kept between scans, keyed by the scan parameters, start state and target pose
+  std::map<std::size_t, Plan> plan_cache_;
+  std::size_t params_key_;
+  planning_scene::PlanningScenePtr planning_scene_;
+
+  // capture, the subscriber is kept alive between poses and scans
+  ros::Subscriber scan_sub_;
+  boost::circular_buffer<sensor_msgs::PointCloud2ConstPtr> capture_buffer_;
+  std::mutex capture_mutex_;
+  std::condition_variable capture_cv_;
+
 public: // parameters
   godel_msgs::RobotScanParameters params_;
 };
@@ -0,0 +1,69 @@
+#ifndef SCAN_COVERAGE_MODEL_H_
+#define SCAN_COVERAGE_MODEL_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <Eigen/Core>
+#include <vector>
+
+namespace godel_surface_detection
+{
+namespace scan
+{
+
+/**
+ * @brief Voxel visibility model of a cubic region around the scanned part. Each voxel is unknown, free or
+ * occupied; captures mark the voxels they hit as occupied and carve the space between camera and hit as free.
+ * Used to rank candidate scan poses by how many unknown voxels they are expected to uncover.
+ */
+class ScanCoverageModel
+{
+public:
+  static const int GRID_CELLS;         // voxels along each edge of the region
+  static const int RAYS_PER_AXIS;      // rays cast per image axis when estimating the gain of a view
+  static const double FOV_HALF_ANGLE;  // radians
+
+public:
+  /**
+   * @brief Tracks a cube of edge length 'size' centered at 'center'; all voxels start out unknown
+   */
+  ScanCoverageModel(const Eigen::Vector3d& center, double size);
+
+  /**
+   * @brief Fuses a capture taken from 'origin'; the cloud must be expressed in the same frame as the region
+   */
+  void insert_cloud(const pcl::PointCloud<pcl::PointXYZRGB>& cloud, const Eigen::Vector3d& origin);
+
+  /**
+   * @brief Number of unknown voxels a camera at 'origin' looking at 'target' would see before its rays are
+   * stopped by occupied voxels or leave the region
+   */
+  std::size_t expected_gain(const Eigen::Vector3d& origin, const Eigen::Vector3d& target) const;
+
+private:
+  enum CellState
+  {
+    UNKNOWN = 0,
+    FREE,
+    OCCUPIED
+  };
+
+  // indices of the voxels the ray origin + t * dir crosses inside the region for t < t_max, in order
+  void traverse(const Eigen::Vector3d& origin, const Eigen::Vector3d& dir, double t_max,
+                std::vector<std::size_t>& ray) const;
+
+  bool to_index(const Eigen::Vector3d& p, std::size_t& index) const;
+
+  // parameters [t_enter, t_exit] of the part of the ray origin + t * dir that lies inside the region
+  bool clip_ray(const Eigen::Vector3d& origin, const Eigen::Vector3d& dir, double& t_enter,
+                double& t_exit) const;
+
+  Eigen::Vector3d min_corner_;
+  Eigen::Vector3d max_corner_;
+  double voxel_size_;
+  std::vector<unsigned char> cells_;
+};
+
+} /* namespace scan */
+} /* namespace godel_surface_detection */
+#endif /* SCAN_COVERAGE_MODEL_H_ */
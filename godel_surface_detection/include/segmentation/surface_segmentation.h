@@ -74,6 +74,15 @@ public:
    */
   SurfaceSegmentation(pcl::PointCloud<pcl::PointXYZRGB>::Ptr icloud);
 
+  /**
+   * @brief constructor that reuses previously computed normals instead of estimating them again. Falls back
+   * to computing the normals if inormals does not match icloud in size.
+   * @param icloud the input cloud, must be free of NaNs since no points are removed
+   * @param inormals the normals of icloud, ordered identically to icloud
+   */
+  SurfaceSegmentation(pcl::PointCloud<pcl::PointXYZRGB>::Ptr icloud,
+                      pcl::PointCloud<pcl::Normal>::Ptr inormals);
+
 
   //-------------------- Clouds --------------------//
 
@@ -96,6 +105,16 @@ public:
   void getBoundaryCloud(pcl::PointCloud<pcl::Boundary>::Ptr &boundary_cloud);
   void getSurfaceClouds(std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &surface_clouds);
 
+  /**
+   * @brief returns the normals of each segmented surface, ordered identically to getSurfaceClouds()
+   */
+  void getSurfaceNormals(std::vector<pcl::PointCloud<pcl::Normal>::Ptr> &surface_normals);
+
+  /**
+   * @brief returns the input cloud indices of each segmented surface, ordered identically to getSurfaceClouds()
+   */
+  void getSurfaceIndices(std::vector<pcl::PointIndices> &surface_indices);
+
 
   //-------------------- Computations --------------------//
 
@@ -108,7 +127,18 @@ public:
 
 
   //-------------------- Smoothing --------------------//
-  void smoothVector(const std::vector<double> &x_in, std::vector<double> &x_out, const std::vector<double> &coef);
+
+  /**
+   * @brief SurfaceSegmentation::smoothVector Applies a symmetric, linearly weighted average to a closed sequence.
+   *        The weights are (h + 1 - |k|) for k in [-h, h], h = length / 2. The triangle is evaluated as two cascaded
+   *        running-sum box filters that wrap around the ends, so the cost is O(n) regardless of the kernel length.
+   * @param x_in Input samples, treated as a closed loop
+   * @param x_out Destination for the smoothed samples; may be the same object as x_in
+   * @param scratch Working buffer. Reusing it across calls keeps the smoother allocation-free.
+   * @param length Length of the smoother
+   */
+  void smoothVector(const std::vector<Eigen::Vector3d> &x_in, std::vector<Eigen::Vector3d> &x_out,
+                    std::vector<Eigen::Vector3d> &scratch, int length);
 
   /**
    * @brief SurfaceSegmentation::smoothPointNormal Uses a running weighted average (look-ahead and look-behind
@@ -0,0 +1,66 @@
+#ifndef PROCESS_JOB_QUEUE_H
+#define PROCESS_JOB_QUEUE_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+#include <godel_msgs/ProcessPlan.h>
+
+namespace godel_surface_detection
+{
+
+/**
+ * A motion plan that is ready to be executed. Jobs with a lower priority run first; jobs of equal
+ * priority run in the order they were pushed.
+ */
+struct ProcessJob
+{
+  int priority;
+  std::string name;
+  godel_msgs::ProcessPlan plan;
+};
+
+/**
+ * Hands motion plans from the thread planning them to the thread executing them, so that the first
+ * plan can run while the rest are still being planned.
+ */
+class ProcessJobQueue
+{
+public:
+  ProcessJobQueue();
+
+  // Ignored once the queue is closed or cancelled
+  void push(const ProcessJob& job);
+
+  // Blocks until a job is ready; false once the queue is closed and empty, or cancelled
+  bool pop(ProcessJob& job);
+
+  // No more jobs will be pushed; pop() drains the remaining ones
+  void close();
+
+  // Drops the pending jobs and releases every waiting pop()
+  void cancel();
+
+  bool cancelled() const;
+
+private:
+  struct Entry
+  {
+    ProcessJob job;
+    std::size_t sequence;
+  };
+
+  static bool runsAfter(const Entry& a, const Entry& b);
+
+  std::vector<Entry> heap_;
+  std::size_t sequence_;
+  bool closed_;
+  bool cancelled_;
+  mutable std::mutex mutex_;
+  std::condition_variable ready_;
+};
+}
+
+#endif
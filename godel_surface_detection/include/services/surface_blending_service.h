@@ -48,10 +48,15 @@
 #include <godel_process_path_generation/polygon_utils.h>
 
 #include <services/trajectory_library.h>
+#include <services/process_job_queue.h>
 #include <coordination/data_coordinator.h>
 
 #include <pcl/console/parse.h>
 #include <rosbag/bag.h>
+#include <godel_utils/joint_state_cache.h>
+#include <functional>
+#include <memory>
+#include <mutex>
 
 //  marker namespaces
 const static std::string BOUNDARY_NAMESPACE = "process_boundary";
@@ -131,9 +136,24 @@ private:
   surface_blend_parameters_server_callback(godel_msgs::SurfaceBlendingParameters::Request& req,
                                            godel_msgs::SurfaceBlendingParameters::Response& res);
 
-  // Reads from the surface selection server and generates blend/scan paths for each
+  // Reads from the surface selection server and generates blend/scan paths for each. If 'queue' is given,
+  // each plan is also pushed to it as soon as it is ready and planning stops once the queue is cancelled.
+  // Plans start from and return to 'start_state', or to the robot's state when each is planned if empty.
   godel_surface_detection::TrajectoryLibrary
-  generateMotionLibrary(const godel_msgs::PathPlanningParameters& params);
+  generateMotionLibrary(const godel_msgs::PathPlanningParameters& params,
+                        godel_surface_detection::ProcessJobQueue* queue = nullptr,
+                        const std::vector<double>& start_state = std::vector<double>());
+
+  // Sends 'plan' to its execution server and, if 'wait_for_execution', waits for it to finish or for
+  // 'preempted' to return true. Returns a godel_msgs::SelectMotionPlanResult code.
+  int executeProcessPlan(const godel_msgs::ProcessPlan& plan, bool simulate, bool wait_for_execution,
+                         const std::function<bool()>& preempted);
+
+  // Executes the plans of the selected surfaces while the remaining ones are still being planned
+  bool planAndExecute(const godel_msgs::ProcessPlanningGoalConstPtr& goal);
+
+  // Publishes 'status' as the last completed step of process planning; safe to call from any thread
+  void publishPlanningFeedback(const std::string& status);
 
 
   bool generateProcessPath(const int& id, ProcessPathResult& result);
@@ -143,6 +163,7 @@ private:
                            const std::string& name,
                            const pcl::PolygonMesh& mesh,
                            const godel_surface_detection::detection::CloudRGB::Ptr,
+                           const godel_surface_detection::detection::Normals::Ptr,
                            ProcessPathResult& result);
 
 
@@ -157,13 +178,25 @@ private:
 
 
   bool generateEdgePath(godel_surface_detection::detection::CloudRGB::Ptr surface,
+                        godel_surface_detection::detection::Normals::Ptr normals,
                         std::vector<geometry_msgs::PoseArray>& result);
 
 
   ProcessPlanResult generateProcessPlan(const std::string& name,
                                         const std::vector<geometry_msgs::PoseArray> &path,
                                         const godel_msgs::BlendingPlanParameters& params,
-                                        const godel_msgs::ScanPlanParameters& scan_params);
+                                        const godel_msgs::ScanPlanParameters& scan_params,
+                                        const std::vector<double>& start_state);
+
+  /**
+   * Plans all of 'paths' as one chained job named 'name' (a blend or scan name); the approach to each
+   * path starts where the one before it ended
+   */
+  ProcessPlanResult generateJobPlan(const std::string& name,
+                                    const ProcessPathResult& paths,
+                                    const godel_msgs::BlendingPlanParameters& params,
+                                    const godel_msgs::ScanPlanParameters& scan_params,
+                                    const std::vector<double>& start_state);
 
 
   bool getMotionPlansCallback(godel_msgs::GetAvailableMotionPlans::Request& req,
@@ -206,12 +239,16 @@ private:
   actionlib::SimpleActionServer<godel_msgs::ProcessPlanningAction> process_planning_server_;
   actionlib::SimpleActionServer<godel_msgs::SelectMotionPlanAction> select_motion_plan_server_;
   godel_msgs::ProcessPlanningFeedback process_planning_feedback_;
+  std::mutex feedback_mutex_; // guards process_planning_feedback_, written by the planner and executor threads
   godel_msgs::ProcessPlanningResult process_planning_result_;
 
   // Actions subscribed to by this class
   actionlib::SimpleActionClient<godel_msgs::ProcessExecutionAction> blend_exe_client_;
   actionlib::SimpleActionClient<godel_msgs::ProcessExecutionAction> scan_exe_client_;
 
+  // Latest robot state, kept by one subscription for the lifetime of the service
+  std::unique_ptr<godel_utils::JointStateCache> joint_states_;
+
   // Current state publishers
   ros::Publisher selected_surf_changed_pub_;
   ros::Publisher point_cloud_pub_;
@@ -219,6 +256,7 @@ private:
   ros::Publisher blend_visualization_pub_;
   ros::Publisher edge_visualization_pub_;
   ros::Publisher scan_visualization_pub_;
+  ros::Publisher part_collision_pub_;
 
   // Timers
   bool stop_tool_animation_;
@@ -256,6 +294,8 @@ private:
 
   // msgs
   sensor_msgs::PointCloud2 region_cloud_msg_;
+  bool part_collision_published_ = false; // the scanned part is in the planning scene
+  unsigned detection_id_ = 0; // bumped by every successful detection, sent with each planning request
 
   godel_surface_detection::TrajectoryLibrary trajectory_library_;
   int marker_counter_;
@@ -212,6 +212,94 @@ namespace data
   }
 
 
+  /**
+   * @brief Set the per-point normals of the surface cloud, as computed during detection
+   * @param id ID of the desired record
+   * @param normals Normals ordered identically to the record's surface cloud
+   * @return true if record is found, false otherwise
+   */
+  bool DataCoordinator::setSurfaceNormals(int id, const pcl::PointCloud<pcl::Normal>& normals)
+  {
+    for(auto& rec : records_)
+    {
+      if(id == rec.id_)
+      {
+        rec.surface_normals_ = normals;
+        return true;
+      }
+    }
+
+    ROS_ERROR_STREAM(UNABLE_TO_FIND_RECORD_ERROR << " " << id);
+    return false;
+  }
+
+
+  /**
+   * @brief getSurfaceNormals
+   * @param id ID of the desired record
+   * @param normals Destination for the normals
+   * @return true if record is found, false otherwise
+   */
+  bool DataCoordinator::getSurfaceNormals(int id, pcl::PointCloud<pcl::Normal>& normals)
+  {
+    for(auto& rec : records_)
+    {
+      if(id == rec.id_)
+      {
+        normals = rec.surface_normals_;
+        return true;
+      }
+    }
+
+    ROS_ERROR_STREAM(UNABLE_TO_FIND_RECORD_ERROR << " " << id);
+    return false;
+  }
+
+
+  /**
+   * @brief Set the cluster membership of the surface, i.e. its indices into the process cloud
+   * @param id ID of the desired record
+   * @param indices Indices of the surface points in the process cloud
+   * @return true if record is found, false otherwise
+   */
+  bool DataCoordinator::setSurfaceIndices(int id, const pcl::PointIndices& indices)
+  {
+    for(auto& rec : records_)
+    {
+      if(id == rec.id_)
+      {
+        rec.surface_indices_ = indices;
+        return true;
+      }
+    }
+
+    ROS_ERROR_STREAM(UNABLE_TO_FIND_RECORD_ERROR << " " << id);
+    return false;
+  }
+
+
+  /**
+   * @brief getSurfaceIndices
+   * @param id ID of the desired record
+   * @param indices Destination for the indices
+   * @return true if record is found, false otherwise
+   */
+  bool DataCoordinator::getSurfaceIndices(int id, pcl::PointIndices& indices)
+  {
+    for(auto& rec : records_)
+    {
+      if(id == rec.id_)
+      {
+        indices = rec.surface_indices_;
+        return true;
+      }
+    }
+
+    ROS_ERROR_STREAM(UNABLE_TO_FIND_RECORD_ERROR << " " << id);
+    return false;
+  }
+
+
   /**
    * @brief Add poses comprising the edge of a surface to its record
    * @param id ID of the desired record
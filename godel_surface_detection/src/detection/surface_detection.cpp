@@ -27,6 +27,16 @@
 #include <pcl/filters/voxel_grid.h>
 #include <pcl/pcl_base.h>
 #include <pcl/filters/passthrough.h>
+#include <pcl/filters/extract_indices.h>
+#include <pcl/sample_consensus/method_types.h>
+#include <pcl/sample_consensus/model_types.h>
+#include <pcl/search/kdtree.h>
+#include <pcl/segmentation/sac_segmentation.h>
+#include <boost/functional/hash.hpp>
+#include <shape_msgs/SolidPrimitive.h>
+#include <cmath>
+#include <limits>
+#include <map>
 
 namespace godel_surface_detection
 {
@@ -76,6 +86,8 @@ static const bool USE_TABLETOP_SEGMENTATION = true;
 static const double TABLETOP_SEG_DISTANCE_THRESH = 0.005f;
 
 static const double MARKER_ALPHA = 1.0f;
+
+static const double PART_COLUMN_SIZE = 0.02f;
 }
 
 namespace config
@@ -129,6 +141,9 @@ static const std::string MARKER_ALPHA = "marker_alpha";
 }
 
 static const float INPUT_CLOUD_VOXEL_FILTER_SIZE = 0.0015;
+static const double TABLETOP_SEG_MAX_ANGLE = M_PI / 18.0; // table normal may deviate 10 deg from world z
+static const double TABLETOP_SEG_MAX_POINTS_BELOW = 0.05; // a table plane has (almost) nothing underneath it
+static const int TABLETOP_SEG_MAX_ITERATIONS = 100;
 const static int DOWNSAMPLE_NUMBER = 3;
 const static std::string MESHING_PLUGIN_PARAM = "meshing_plugin_name";
 
@@ -140,6 +155,8 @@ namespace godel_surface_detection
       : full_cloud_ptr_(new CloudRGB())
       , process_cloud_ptr_(new CloudRGB())
       , acquired_clouds_counter_(0)
+      , filter_cache_key_(0)
+      , segmentation_cache_key_(0)
       , random_engine_(0) // This is using a fixed seed for down-sampling at the moment
     {
       params_.frame_id = defaults::FRAME_ID;
@@ -182,8 +199,12 @@ namespace godel_surface_detection
       full_cloud_ptr_->clear();
       process_cloud_ptr_->clear();
       surface_clouds_.clear();
+      surface_normals_.clear();
+      surface_indices_.clear();
       mesh_markers_.markers.clear();
       meshes_.clear();
+      filter_cache_key_ = 0;
+      segmentation_cache_key_ = 0;
     }
 
     bool SurfaceDetection::load_parameters(const std::string& filename)
@@ -292,6 +313,18 @@ namespace godel_surface_detection
       surfaces.insert(surfaces.end(), surface_clouds_.begin(), surface_clouds_.end());
     }
 
+
+    void SurfaceDetection::get_surface_normals(std::vector<Normals::Ptr>& normals)
+    {
+      normals.insert(normals.end(), surface_normals_.begin(), surface_normals_.end());
+    }
+
+
+    void SurfaceDetection::get_surface_indices(std::vector<pcl::PointIndices>& indices)
+    {
+      indices.insert(indices.end(), surface_indices_.begin(), surface_indices_.end());
+    }
+
     void SurfaceDetection::get_full_cloud(CloudRGB& cloud)
     {
       pcl::copyPointCloud(*full_cloud_ptr_, cloud);
@@ -312,6 +345,98 @@ namespace godel_surface_detection
       pcl::toROSMsg(*process_cloud_ptr_, cloud_msg);
     }
 
+    bool SurfaceDetection::get_part_collision_object(const std::string& id, moveit_msgs::CollisionObject& object)
+    {
+      if (!process_cloud_ptr_ || process_cloud_ptr_->empty())
+        return false;
+
+      // top-down grid of the process cloud, recording the highest point and the number of points of each cell
+      const double cell = defaults::PART_COLUMN_SIZE;
+      typedef std::pair<int, int> CellIndex;
+      std::map<CellIndex, std::pair<float, int> > cells;
+      float base = std::numeric_limits<float>::max();
+      for (const auto& pt : process_cloud_ptr_->points)
+      {
+        if (!pcl_isfinite(pt.x))
+          continue;
+
+        const CellIndex index(static_cast<int>(std::floor(pt.x / cell)), static_cast<int>(std::floor(pt.y / cell)));
+        auto it = cells.find(index);
+        if (it == cells.end())
+          cells[index] = std::make_pair(pt.z, 1);
+        else
+        {
+          it->second.first = std::max(it->second.first, pt.z);
+          it->second.second++;
+        }
+        base = std::min(base, pt.z);
+      }
+
+      if (cells.empty())
+        return false;
+
+      // sparse cells are sensor noise; a cell is occupied once it holds this fraction of the average count
+      const double min_points = params_.occupancy_threshold * process_cloud_ptr_->size() / cells.size();
+
+      object = moveit_msgs::CollisionObject();
+      object.header.frame_id = params_.frame_id;
+      object.header.stamp = ros::Time::now();
+      object.id = id;
+      object.operation = moveit_msgs::CollisionObject::ADD;
+
+      // cells are ordered by x and then y, so neighbours along y of similar height merge into one box
+      auto add_box = [&object, cell, base](const CellIndex& first, int count, float top) {
+        shape_msgs::SolidPrimitive box;
+        box.type = shape_msgs::SolidPrimitive::BOX;
+        box.dimensions.resize(3);
+        box.dimensions[shape_msgs::SolidPrimitive::BOX_X] = cell;
+        box.dimensions[shape_msgs::SolidPrimitive::BOX_Y] = count * cell;
+        box.dimensions[shape_msgs::SolidPrimitive::BOX_Z] = std::max(static_cast<double>(top - base), cell);
+
+        geometry_msgs::Pose pose;
+        pose.position.x = (first.first + 0.5) * cell;
+        pose.position.y = (first.second + 0.5 * count) * cell;
+        pose.position.z = top - 0.5 * box.dimensions[shape_msgs::SolidPrimitive::BOX_Z];
+        pose.orientation.w = 1.0;
+
+        object.primitives.push_back(box);
+        object.primitive_poses.push_back(pose);
+      };
+
+      bool open = false;
+      CellIndex run_start;
+      int run_length = 0;
+      float run_top = 0.0f;
+      for (const auto& c : cells)
+      {
+        if (c.second.second < min_points)
+          continue;
+
+        const bool extends = open && c.first.first == run_start.first &&
+                             c.first.second == run_start.second + run_length &&
+                             std::abs(c.second.first - run_top) < cell;
+        if (extends)
+        {
+          run_top = std::max(run_top, c.second.first);
+          run_length++;
+          continue;
+        }
+
+        if (open)
+          add_box(run_start, run_length, run_top);
+        open = true;
+        run_start = c.first;
+        run_length = 1;
+        run_top = c.second.first;
+      }
+      if (open)
+        add_box(run_start, run_length, run_top);
+
+      ROS_INFO("Part collision object '%s' has %d boxes from %d cells", id.c_str(),
+               static_cast<int>(object.primitives.size()), static_cast<int>(cells.size()));
+      return !object.primitives.empty();
+    }
+
     void SurfaceDetection::get_region_colored_cloud(CloudRGB& cloud)
     {
       pcl::copyPointCloud(*region_colored_cloud_ptr_, cloud);
@@ -330,7 +455,6 @@ namespace godel_surface_detection
       SWRI_PROFILE("find-surfaces");
 
       // Reset members
-      surface_clouds_.clear();
       mesh_markers_.markers.clear();
       meshes_.clear();
 
@@ -338,16 +462,44 @@ namespace godel_surface_detection
       if (full_cloud_ptr_->empty())
         return false;
 
-      filterFullCloud();
+      // Filtering and segmentation are skipped when their inputs match the previous run, so that re-running
+      // detection after changing e.g. meshing parameters only repeats the meshing
+      const std::size_t filter_key = filterCacheKey();
+      if (filter_key != filter_cache_key_)
+      {
+        filterFullCloud();
+        filter_cache_key_ = filter_key;
+      }
+      else
+      {
+        ROS_INFO("Reusing cached process cloud of %d points", static_cast<int>(process_cloud_ptr_->size()));
+      }
+
+      // Segmentation uses fixed parameters, so its result only depends on the process cloud
+      if (filter_cache_key_ != segmentation_cache_key_)
+      {
+        surface_clouds_.clear();
+        surface_normals_.clear();
+        surface_indices_.clear();
+
+        // Segment the part into surface clusters using a "region growing" scheme
+        SurfaceSegmentation SS(process_cloud_ptr_);
+        region_colored_cloud_ptr_ = CloudRGB::Ptr(new CloudRGB());
+        {
+          SWRI_PROFILE("segment-clouds");
+          SS.computeSegments(region_colored_cloud_ptr_);
+        }
+        SS.getSurfaceClouds(surface_clouds_);
 
-      // Segment the part into surface clusters using a "region growing" scheme
-      SurfaceSegmentation SS(process_cloud_ptr_);
-      region_colored_cloud_ptr_ = CloudRGB::Ptr(new CloudRGB());
+        // Keep the normals and cluster membership so downstream edge generation can skip normal estimation
+        SS.getSurfaceNormals(surface_normals_);
+        SS.getSurfaceIndices(surface_indices_);
+        segmentation_cache_key_ = filter_cache_key_;
+      }
+      else
       {
-        SWRI_PROFILE("segment-clouds");
-        SS.computeSegments(region_colored_cloud_ptr_);
+        ROS_INFO("Reusing %d cached surface segments", static_cast<int>(surface_clouds_.size()));
       }
-      SS.getSurfaceClouds(surface_clouds_);
 
       // Load the code to perform meshing dynamically
       pluginlib::ClassLoader<meshing_plugins_base::MeshingBase>
@@ -411,9 +563,142 @@ namespace godel_surface_detection
       return name;
     }
 
+    std::size_t SurfaceDetection::filterCacheKey() const
+    {
+      SWRI_PROFILE("hash-full-cloud");
+      std::size_t seed = full_cloud_ptr_->size();
+      for (const auto& pt : full_cloud_ptr_->points)
+      {
+        boost::hash_combine(seed, pt.x);
+        boost::hash_combine(seed, pt.y);
+        boost::hash_combine(seed, pt.z);
+        boost::hash_combine(seed, pt.rgba);
+      }
+
+      boost::hash_combine(seed, params_.meanK);
+      boost::hash_combine(seed, params_.stdv_threshold);
+      boost::hash_combine(seed, params_.use_tabletop_seg);
+      boost::hash_combine(seed, params_.tabletop_seg_distance_threshold);
+
+      // 0 is reserved for 'no cached result'
+      return seed == 0 ? 1 : seed;
+    }
+
+    /**
+     * @brief statisticalOutlierFilter removes points whose mean distance to their mean_k nearest neighbors is more
+     * than stdv_threshold standard deviations above the cloud-wide average. Equivalent to
+     * pcl::StatisticalOutlierRemoval, but the neighbor queries are spread across all cores.
+     */
+    static void statisticalOutlierFilter(const CloudRGB::Ptr& input, int mean_k, double stdv_threshold,
+                                         CloudRGB& output)
+    {
+      const int n = static_cast<int>(input->size());
+      if (mean_k <= 0 || n <= mean_k)
+      {
+        pcl::copyPointCloud(*input, output);
+        return;
+      }
+
+      pcl::search::KdTree<pcl::PointXYZRGB> tree;
+      tree.setInputCloud(input);
+
+      // mean distance of every point to its neighbors, the query point itself is the first result
+      std::vector<float> mean_distances(n);
+      #pragma omp parallel
+      {
+        std::vector<int> nn_indices(mean_k + 1);
+        std::vector<float> nn_sqr_dists(mean_k + 1);
+
+        #pragma omp for schedule(static)
+        for (int i = 0; i < n; ++i)
+        {
+          const int found = tree.nearestKSearch(input->points[i], mean_k + 1, nn_indices, nn_sqr_dists);
+          double sum = 0.0;
+          for (int k = 1; k < found; ++k)
+            sum += std::sqrt(nn_sqr_dists[k]);
+          mean_distances[i] = found > 1 ? static_cast<float>(sum / (found - 1)) : 0.0f;
+        }
+      }
+
+      double sum = 0.0, sq_sum = 0.0;
+      for (const float d : mean_distances)
+      {
+        sum += d;
+        sq_sum += d * d;
+      }
+      const double mean = sum / n;
+      const double stddev = std::sqrt(std::max(0.0, (sq_sum - sum * sum / n) / (n - 1)));
+      const double distance_threshold = mean + stdv_threshold * stddev;
+
+      output.clear();
+      output.header = input->header;
+      output.reserve(n);
+      for (int i = 0; i < n; ++i)
+      {
+        if (mean_distances[i] <= distance_threshold)
+          output.push_back(input->points[i]);
+      }
+    }
+
+    /**
+     * @brief removeTablePlane finds the dominant, roughly horizontal plane with RANSAC and removes it if it
+     * supports the rest of the cloud, i.e. almost no points lie below it. A horizontal face of the part itself has
+     * the remainder of the part underneath and is left alone.
+     * @return true if a table plane was found and removed
+     */
+    static bool removeTablePlane(const CloudRGB::Ptr& input, double distance_threshold, CloudRGB& output)
+    {
+      pcl::ModelCoefficients::Ptr coeffs (new pcl::ModelCoefficients());
+      pcl::PointIndices::Ptr inliers (new pcl::PointIndices());
+      pcl::SACSegmentation<pcl::PointXYZRGB> seg;
+      seg.setOptimizeCoefficients(true);
+      seg.setModelType(pcl::SACMODEL_PERPENDICULAR_PLANE);
+      seg.setAxis(Eigen::Vector3f::UnitZ());
+      seg.setEpsAngle(TABLETOP_SEG_MAX_ANGLE);
+      seg.setMethodType(pcl::SAC_RANSAC);
+      seg.setMaxIterations(TABLETOP_SEG_MAX_ITERATIONS);
+      seg.setDistanceThreshold(distance_threshold);
+      seg.setInputCloud(input);
+      seg.segment(*inliers, *coeffs);
+
+      if (inliers->indices.empty() || coeffs->values.size() != 4)
+        return false;
+
+      // orient the plane normal upwards and count the points underneath it
+      Eigen::Vector4f plane (coeffs->values[0], coeffs->values[1], coeffs->values[2], coeffs->values[3]);
+      plane /= plane.head<3>().norm();
+      if (plane.z() < 0.0f)
+        plane = -plane;
+
+      const int n = static_cast<int>(input->size());
+      int below = 0;
+      #pragma omp parallel for reduction(+:below)
+      for (int i = 0; i < n; ++i)
+      {
+        const pcl::PointXYZRGB& pt = input->points[i];
+        if (plane.dot(Eigen::Vector4f(pt.x, pt.y, pt.z, 1.0f)) < -distance_threshold)
+          ++below;
+      }
+
+      if (below > TABLETOP_SEG_MAX_POINTS_BELOW * n)
+      {
+        ROS_INFO("Dominant horizontal plane has %d of %d points below it; not treating it as the table", below, n);
+        return false;
+      }
+
+      pcl::ExtractIndices<pcl::PointXYZRGB> extract;
+      extract.setInputCloud(input);
+      extract.setIndices(inliers);
+      extract.setNegative(true);
+      extract.filter(output);
+      return true;
+    }
+
     void SurfaceDetection::filterFullCloud()
     {
+      SWRI_PROFILE("filter-full-cloud");
       pcl::PointCloud<pcl::PointXYZRGB>::Ptr intermediate_cloud_ptr(new pcl::PointCloud<pcl::PointXYZRGB>);
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr downsampled_cloud_ptr(new pcl::PointCloud<pcl::PointXYZRGB>);
 
       //remove the table using the passthrough filter
       pcl::PassThrough<pcl::PointXYZRGB> pass;
@@ -426,13 +711,31 @@ namespace godel_surface_detection
       pass.setFilterLimits (MINIMUM_DISTANCE, MAXIMUM_DISTANCE);
       pass.filter (*intermediate_cloud_ptr);
 
-      //downsample the full cloud using the voxelgrid filter method
+      //downsample the full cloud using the voxelgrid filter method. Doing this first means the more expensive
+      //filters below only ever see one point per voxel.
       pcl::VoxelGrid<pcl::PointXYZRGB> vox;
       vox.setInputCloud (intermediate_cloud_ptr);
       vox.setLeafSize (INPUT_CLOUD_VOXEL_FILTER_SIZE,
                        INPUT_CLOUD_VOXEL_FILTER_SIZE,
                        INPUT_CLOUD_VOXEL_FILTER_SIZE);
-      vox.filter(*process_cloud_ptr_);
+      vox.filter(*downsampled_cloud_ptr);
+
+      //remove sensor noise with a statistical outlier filter on the reduced cloud
+      {
+        SWRI_PROFILE("statistical-outlier-removal");
+        statisticalOutlierFilter(downsampled_cloud_ptr, params_.meanK, params_.stdv_threshold,
+                                 *intermediate_cloud_ptr);
+      }
+
+      //remove any remaining table points that the passthrough missed (e.g. a tilted or raised table)
+      if (params_.use_tabletop_seg && !intermediate_cloud_ptr->empty())
+      {
+        SWRI_PROFILE("tabletop-segmentation");
+        if (removeTablePlane(intermediate_cloud_ptr, params_.tabletop_seg_distance_threshold, *process_cloud_ptr_))
+          return;
+      }
+
+      pcl::copyPointCloud(*intermediate_cloud_ptr, *process_cloud_ptr_);
     }
   } /* end namespace detection */
 } /* end namespace godel_surface_detection */
@@ -15,6 +15,7 @@
 */
 
 #include <scan/robot_scan.h>
+#include <scan/scan_coverage_model.h>
 #include <pcl_ros/transforms.h>
 #include <pcl_conversions/pcl_conversions.h>
 #include <pcl/common/common.h>
@@ -23,10 +24,19 @@
 #include <boost/assert.hpp>
 #include <math.h>
 #include <moveit/robot_state/conversions.h>
+#include <moveit_msgs/GetPlanningScene.h>
 #include <moveit/trajectory_processing/iterative_time_parameterization.h>
 #include <godel_param_helpers/godel_param_helpers.h>
+#include <boost/functional/hash.hpp>
+#include <tf_conversions/tf_eigen.h>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
 
 static const std::string DEFAULT_MOVEIT_PLANNER = "RRTConnectkConfigDefault";
+static const std::string GET_PLANNING_SCENE_SERVICE = "get_planning_scene";
 
 static bool loadPoseParam(ros::NodeHandle& nh, const std::string& name, geometry_msgs::Pose& pose)
 {
@@ -40,6 +50,88 @@ static bool loadPoseParam(ros::NodeHandle& nh, const std::string& name, geometry
          loadParam(nh, name + "/quat/w", pose.orientation.w);
 }
 
+/**
+ * @brief Runs a handler for each pushed job, in order, on a single background thread. The destructor waits for
+ * all queued jobs to finish.
+ */
+template <typename Job>
+class ProcessingQueue
+{
+public:
+  typedef boost::function<void(const Job&)> Handler;
+
+  explicit ProcessingQueue(Handler handler)
+    : handler_(handler), done_(false), worker_(&ProcessingQueue::run, this)
+  {}
+
+  ~ProcessingQueue()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_ = true;
+    }
+    cv_.notify_one();
+    worker_.join();
+  }
+
+  void push(const Job& job)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      jobs_.push_back(job);
+    }
+    cv_.notify_one();
+  }
+
+private:
+  void run()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+    {
+      cv_.wait(lock, [this] { return done_ || !jobs_.empty(); });
+      if (jobs_.empty())
+        return; // done and drained
+
+      Job job = jobs_.front();
+      jobs_.pop_front();
+      lock.unlock();
+      handler_(job);
+      lock.lock();
+    }
+  }
+
+  Handler handler_;
+  std::deque<Job> jobs_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool done_;
+  std::thread worker_;
+};
+
+// hash over the serialized message, any change to the parameters changes it
+static std::size_t hashParameters(const godel_msgs::RobotScanParameters& params)
+{
+  std::vector<uint8_t> buffer (ros::serialization::serializationLength(params));
+  ros::serialization::OStream stream (buffer.data(), buffer.size());
+  ros::serialization::serialize(stream, params);
+  return boost::hash_range(buffer.begin(), buffer.end());
+}
+
+// robot state at the final point of a planned trajectory
+static moveit::core::RobotState trajectoryEndState(const moveit::core::RobotState& reference,
+                                                   const moveit_msgs::RobotTrajectory& traj)
+{
+  moveit::core::RobotState end_state (reference);
+  const trajectory_msgs::JointTrajectory& jt = traj.joint_trajectory;
+  if (!jt.points.empty())
+  {
+    end_state.setVariablePositions(jt.joint_names, jt.points.back().positions);
+    end_state.update();
+  }
+  return end_state;
+}
+
 namespace godel_surface_detection
 {
 namespace scan
@@ -50,8 +142,13 @@ const double RobotScan::WAIT_MSG_DURATION = 5.0f;
 const double RobotScan::MIN_TRAJECTORY_TIME_STEP = 0.8f; // seconds
 const double RobotScan::EEF_STEP = 0.05f;                // 5cm
 const double RobotScan::MIN_JOINT_VELOCITY = 0.01f;      // rad/sect
+const double RobotScan::SETTLE_SAMPLE_PERIOD = 0.05f;    // seconds
+const double RobotScan::SETTLE_TIMEOUT = 2.0f;           // seconds
+const int RobotScan::CAPTURE_BUFFER_SIZE = 4;
+const std::size_t RobotScan::PLAN_CACHE_SIZE = 256;
+const double RobotScan::PLAN_CACHE_JOINT_RESOLUTION = 0.001; // rad
 
-RobotScan::RobotScan()
+RobotScan::RobotScan() : capture_buffer_(CAPTURE_BUFFER_SIZE), params_key_(0)
 {
 
   params_.group_name = "manipulator_asus";
@@ -70,18 +167,26 @@ RobotScan::RobotScan()
   params_.reachable_scan_points_ratio = 0.5f;
   params_.num_scan_points = 20;
   params_.stop_on_planning_error = true;
+  params_.use_coverage_planning = false;
+  params_.coverage_region_size = 0.6;
+  params_.min_coverage_gain = 0.1;
 }
 
 bool RobotScan::init()
 {
   move_group_ptr_ = MoveGroupPtr(new  moveit::planning_interface::MoveGroupInterface(params_.group_name));
-  move_group_ptr_->setEndEffectorLink(params_.tcp_frame);
-  move_group_ptr_->setPoseReferenceFrame(params_.world_frame);
-  move_group_ptr_->setPlanningTime(PLANNING_TIME);
-  move_group_ptr_->setPlannerId(DEFAULT_MOVEIT_PLANNER);
+  planning_group_ptr_ = MoveGroupPtr(new  moveit::planning_interface::MoveGroupInterface(params_.group_name));
+  for (const MoveGroupPtr& group : {move_group_ptr_, planning_group_ptr_})
+  {
+    group->setEndEffectorLink(params_.tcp_frame);
+    group->setPoseReferenceFrame(params_.world_frame);
+    group->setPlanningTime(PLANNING_TIME);
+    group->setPlannerId(DEFAULT_MOVEIT_PLANNER);
+  }
   tf_listener_ptr_ = TransformListenerPtr(new tf::TransformListener());
   scan_traj_poses_.clear();
   callback_list_.clear();
+  plan_cache_.clear();
   return true;
 }
 
@@ -111,7 +216,10 @@ bool RobotScan::load_parameters(const std::string& filename)
          loadParam(nh, "num_scan_points", params_.num_scan_points) &&
          loadParam(nh, "reachable_scan_points_ratio", params_.reachable_scan_points_ratio) &&
          loadParam(nh, "scan_target_frame", params_.scan_target_frame) &&
-         loadBoolParam(nh, "stop_on_planning_error", params_.stop_on_planning_error);
+         loadBoolParam(nh, "stop_on_planning_error", params_.stop_on_planning_error) &&
+         loadBoolParam(nh, "use_coverage_planning", params_.use_coverage_planning) &&
+         loadParam(nh, "coverage_region_size", params_.coverage_region_size) &&
+         loadParam(nh, "min_coverage_gain", params_.min_coverage_gain);
 }
 
 void RobotScan::save_parameters(const std::string& filename)
@@ -177,150 +285,473 @@ bool RobotScan::move_to_pose(geometry_msgs::Pose& target_pose)
 
 int RobotScan::scan(bool move_only)
 {
-  // cartesian path generation
-  double eef_step = EEF_STEP; // 1*alpha_incr*params_.cam_to_obj_xoffset;
-  double jump_threshold = 0.0;
-  moveit::planning_interface::MoveGroupInterface::Plan path_plan;
-  geometry_msgs::PoseArray cartesian_poses;
-  path_plan.planning_time_ = PLANNING_TIME;
-
   // create trajectory
   scan_traj_poses_.clear();
   int poses_reached = 0;
   moveit_msgs::RobotTrajectory robot_traj;
-  if (create_scan_trajectory(scan_traj_poses_, robot_traj))
+  if (!create_scan_trajectory(scan_traj_poses_, robot_traj))
+  {
+    return poses_reached;
+  }
+
+  // Moves planned during earlier scans with the same parameters are replayed if they are still collision free
+  params_key_ = hashParameters(params_);
+  if (!plan_cache_.empty())
+  {
+    update_planning_scene();
+  }
+
+  // (Re)subscribe only when the scan topic changed, the subscription otherwise persists across scans
+  if (!move_only && (!scan_sub_ || scan_sub_.getTopic() != ros::names::resolve(params_.scan_topic)))
+  {
+    ros::NodeHandle nh;
+    scan_sub_ = nh.subscribe(params_.scan_topic, 1, &RobotScan::capture_callback, this);
+  }
+
+  if (params_.use_coverage_planning && !move_only)
+  {
+    if (params_.scan_target_frame == params_.world_frame)
+    {
+      return scan_for_coverage();
+    }
+
+    ROS_WARN_STREAM("Coverage planning requires clouds in the world frame '" << params_.world_frame
+                    << "', scanning the full sweep instead");
+  }
+
+  // Captured clouds are converted, transformed and handed to the scan callbacks in the background while the
+  // robot moves on to the next pose
+  ProcessingQueue<sensor_msgs::PointCloud2ConstPtr> processing_queue (
+      boost::bind(&RobotScan::process_capture, this, _1));
+
+  // The move to pose i + 1 is planned, starting from where move i ends, while move i executes
+  moveit::core::RobotState start_state (*move_group_ptr_->getCurrentState());
+  Plan plan;
+  bool planned = cached_plan_to_pose(start_state, scan_traj_poses_.front(), plan);
+
+  for (std::size_t i = 0; i < scan_traj_poses_.size(); i++)
+  {
+    const bool last_pose = (i + 1 == scan_traj_poses_.size());
+
+    if (!planned)
+    {
+      if (params_.stop_on_planning_error)
+      {
+        ROS_ERROR_STREAM("Path Planning to scan position " << i + 1 << " failed, quitting scan");
+        break;
+      }
+
+      ROS_WARN_STREAM("Path Planning to scan position " << i + 1 << " failed, skipping scan");
+      if (!last_pose)
+      {
+        planned = cached_plan_to_pose(start_state, scan_traj_poses_[i + 1], plan);
+      }
+      continue;
+    }
+
+    const Plan current_plan = plan;
+    std::future<bool> execution = std::async(std::launch::async, [this, &current_plan]() {
+      return static_cast<bool>(move_group_ptr_->execute(current_plan));
+    });
+
+    const moveit::core::RobotState end_state = trajectoryEndState(start_state, current_plan.trajectory_);
+    planned = !last_pose && cached_plan_to_pose(end_state, scan_traj_poses_[i + 1], plan);
+
+    if (!execution.get())
+    {
+      if (params_.stop_on_planning_error)
+      {
+        ROS_ERROR_STREAM("Path Execution to scan position " << i + 1 << " failed, quitting scan");
+        break;
+      }
+
+      ROS_WARN_STREAM("Path Execution to scan position " << i + 1 << " failed, skipping scan");
+
+      // the next move was planned from a state the robot never reached
+      start_state = *move_group_ptr_->getCurrentState();
+      if (!last_pose)
+      {
+        planned = cached_plan_to_pose(start_state, scan_traj_poses_[i + 1], plan);
+      }
+      continue;
+    }
+
+    poses_reached++;
+    start_state = end_state;
+
+    if (move_only)
+    {
+      ROS_WARN_STREAM("MOVE_ONLY mode, skipping scan");
+      continue;
+    }
+
+    // get message once the robot has come to rest
+    ros::Time settle_time;
+    if (!wait_for_settle(settle_time))
+    {
+      ROS_WARN_STREAM("Robot did not settle at scan position " << i + 1 << " within " << SETTLE_TIMEOUT << "s");
+    }
+
+    // only a frame taken after the robot came to rest is free of motion blur
+    sensor_msgs::PointCloud2ConstPtr msg = wait_for_capture(settle_time, ros::Duration(WAIT_MSG_DURATION));
+    if (!msg)
+    {
+      ROS_ERROR_STREAM("Cloud message not received");
+      continue;
+    }
+
+    processing_queue.push(msg);
+  }
+
+  return poses_reached;
+}
+
+bool RobotScan::plan_to_pose(const moveit::core::RobotState& start, const geometry_msgs::Pose& pose, Plan& plan)
+{
+  planning_group_ptr_->setStartState(start);
+
+  // Todo: What follows is a hack to get saner motions for the automate demonstration
+  // Can fail to plan because the solution is not checked for collisions/limits etc
+  // though in practice it works pretty well.
+  const moveit::core::JointModelGroup* group = start.getJointModelGroup(params_.group_name);
+  moveit::core::RobotState goal (start);
+  if (!goal.setFromIK(group, pose, params_.tcp_frame))
+  {
+    ROS_WARN_STREAM("No IK solution found for scan pose");
+    return false;
+  }
+
+  std::vector<double> to_goto;
+  goal.copyJointGroupPositions(group, to_goto);
+  planning_group_ptr_->setJointValueTarget(to_goto);
+
+  plan = Plan();
+  plan.planning_time_ = PLANNING_TIME;
+  return static_cast<bool>(planning_group_ptr_->plan(plan));
+}
+
+bool RobotScan::cached_plan_to_pose(const moveit::core::RobotState& start, const geometry_msgs::Pose& pose,
+                                    Plan& plan)
+{
+  const std::size_t key = plan_cache_key(start, pose);
+  std::map<std::size_t, Plan>::iterator cached = plan_cache_.find(key);
+  if (cached != plan_cache_.end())
+  {
+    if (is_plan_valid(cached->second))
+    {
+      ROS_INFO_STREAM("Reusing cached plan to scan pose");
+      plan = cached->second;
+      return true;
+    }
+
+    ROS_INFO_STREAM("Cached plan to scan pose is no longer valid, replanning");
+    plan_cache_.erase(cached);
+  }
+
+  if (!plan_to_pose(start, pose, plan))
+  {
+    return false;
+  }
+
+  if (plan_cache_.size() >= PLAN_CACHE_SIZE)
+  {
+    plan_cache_.clear();
+  }
+  plan_cache_[key] = plan;
+  return true;
+}
+
+std::size_t RobotScan::plan_cache_key(const moveit::core::RobotState& start, const geometry_msgs::Pose& pose) const
+{
+  std::size_t seed = params_key_;
+  boost::hash_combine(seed, pose.position.x);
+  boost::hash_combine(seed, pose.position.y);
+  boost::hash_combine(seed, pose.position.z);
+  boost::hash_combine(seed, pose.orientation.x);
+  boost::hash_combine(seed, pose.orientation.y);
+  boost::hash_combine(seed, pose.orientation.z);
+  boost::hash_combine(seed, pose.orientation.w);
+
+  // start states within the resolution of each other share plans, trajectory execution tolerates the difference
+  std::vector<double> joints;
+  start.copyJointGroupPositions(params_.group_name, joints);
+  for (std::size_t i = 0; i < joints.size(); ++i)
+  {
+    boost::hash_combine(seed, std::lround(joints[i] / PLAN_CACHE_JOINT_RESOLUTION));
+  }
+  return seed;
+}
+
+bool RobotScan::update_planning_scene()
+{
+  moveit_msgs::GetPlanningScene srv;
+  srv.request.components.components =
+      moveit_msgs::PlanningSceneComponents::SCENE_SETTINGS | moveit_msgs::PlanningSceneComponents::ROBOT_STATE |
+      moveit_msgs::PlanningSceneComponents::ROBOT_STATE_ATTACHED_OBJECTS |
+      moveit_msgs::PlanningSceneComponents::WORLD_OBJECT_NAMES |
+      moveit_msgs::PlanningSceneComponents::WORLD_OBJECT_GEOMETRY | moveit_msgs::PlanningSceneComponents::OCTOMAP |
+      moveit_msgs::PlanningSceneComponents::TRANSFORMS |
+      moveit_msgs::PlanningSceneComponents::ALLOWED_COLLISION_MATRIX |
+      moveit_msgs::PlanningSceneComponents::LINK_PADDING_AND_SCALING;
+
+  if (!ros::service::call(GET_PLANNING_SCENE_SERVICE, srv))
+  {
+    ROS_WARN_STREAM("Unable to get the planning scene, cached scan plans will not be reused");
+    planning_scene_.reset();
+    return false;
+  }
+
+  planning_scene_.reset(new planning_scene::PlanningScene(move_group_ptr_->getRobotModel()));
+  planning_scene_->setPlanningSceneMsg(srv.response.scene);
+  return true;
+}
+
+bool RobotScan::is_plan_valid(const Plan& plan) const
+{
+  if (!planning_scene_)
   {
-    std::vector<geometry_msgs::Pose> trajectory_poses;
+    return false;
+  }
 
-    // inserting all poses
-    trajectory_poses.push_back(move_group_ptr_->getCurrentPose(params_.tcp_frame).pose);
-    trajectory_poses.insert(trajectory_poses.begin() + 1, scan_traj_poses_.begin(),
-                            scan_traj_poses_.end());
+  moveit::core::RobotState reference (planning_scene_->getCurrentState());
+  moveit::core::robotStateMsgToRobotState(plan.start_state_, reference);
+  robot_trajectory::RobotTrajectory traj (planning_scene_->getRobotModel(), params_.group_name);
+  traj.setRobotTrajectoryMsg(reference, plan.trajectory_);
+  return planning_scene_->isPathValid(traj, params_.group_name);
+}
 
-    for (size_t i = 1; i < trajectory_poses.size(); i++)
+bool RobotScan::wait_for_settle(ros::Time& settle_time)
+{
+  const ros::Time deadline = ros::Time::now() + ros::Duration(SETTLE_TIMEOUT);
+  std::vector<double> last_positions = move_group_ptr_->getCurrentJointValues();
+  ros::Time last_stamp = ros::Time::now();
+
+  while (ros::ok() && ros::Time::now() < deadline)
+  {
+    ros::Duration(SETTLE_SAMPLE_PERIOD).sleep();
+
+    std::vector<double> positions = move_group_ptr_->getCurrentJointValues();
+    ros::Time stamp = ros::Time::now();
+    const double dt = (stamp - last_stamp).toSec();
+
+    double max_velocity = 0.0;
+    for (std::size_t j = 0; j < positions.size() && j < last_positions.size(); ++j)
     {
-      // reset path plan structure
-      path_plan.start_state_ = moveit_msgs::RobotState();
-      path_plan.trajectory_ = moveit_msgs::RobotTrajectory();
-
-      // filling cartesian poses for next move
-      cartesian_poses.poses.clear();
-      cartesian_poses.poses.push_back(trajectory_poses[i]);
-
-      // creating path plan structure and execute
-      move_group_ptr_->setStartStateToCurrentState();
-
-      // Todo: What follows is a hack to get saner motions for the automate demonstration
-      // Can fail to plan because the solution is not checked for collisions/limits etc
-      // though in practice it works pretty well.
-      auto current_state = move_group_ptr_->getCurrentJointValues();
-      auto rob_model = move_group_ptr_->getRobotModel();
-      moveit::core::RobotState state (rob_model);
-      state.setVariablePositions(current_state);
-      state.setFromIK(rob_model->getJointModelGroup(params_.group_name), trajectory_poses[i], params_.tcp_frame);
-      std::vector<double> to_goto (state.getVariablePositions(), state.getVariablePositions() + current_state.size());
-      move_group_ptr_->setJointValueTarget(to_goto);
-//      move_group_ptr_->setPoseTarget(trajectory_poses[i], params_.tcp_frame);
-
-      moveit::planning_interface::MoveGroupInterface::Plan my_plan;
-      bool success = static_cast<bool>(move_group_ptr_->plan(my_plan));
-
-      if (!success)
+      max_velocity = std::max(max_velocity, std::abs(positions[j] - last_positions[j]) / dt);
+    }
+
+    if (max_velocity < MIN_JOINT_VELOCITY)
+    {
+      settle_time = stamp;
+      return true;
+    }
+
+    last_positions.swap(positions);
+    last_stamp = stamp;
+  }
+
+  settle_time = ros::Time::now();
+  return false;
+}
+
+void RobotScan::capture_callback(const sensor_msgs::PointCloud2ConstPtr& msg)
+{
+  {
+    std::lock_guard<std::mutex> lock(capture_mutex_);
+    capture_buffer_.push_back(msg);
+  }
+  capture_cv_.notify_all();
+}
+
+sensor_msgs::PointCloud2ConstPtr RobotScan::wait_for_capture(const ros::Time& after, const ros::Duration& timeout)
+{
+  sensor_msgs::PointCloud2ConstPtr capture;
+  auto find_capture = [this, &after, &capture]() {
+    for (const auto& msg : capture_buffer_)
+    {
+      if (msg->header.stamp > after)
       {
-        if (params_.stop_on_planning_error)
-        {
-          ROS_ERROR_STREAM("Path Planning to scan position " << i << " failed, quitting scan");
-          break;
-        }
-        else
-        {
-          ROS_WARN_STREAM("Path Planning to scan position " << i << " failed, skipping scan");
-          continue;
-        }
+        capture = msg;
+        return true;
       }
+    }
+    return false;
+  };
+
+  std::unique_lock<std::mutex> lock(capture_mutex_);
+  capture_cv_.wait_for(lock, std::chrono::duration<double>(timeout.toSec()), find_capture);
+  return capture;
+}
+
+int RobotScan::scan_for_coverage()
+{
+  tf::Transform tcp_to_cam_tf, world_to_obj_tf;
+  tf::poseMsgToTF(params_.tcp_to_cam_pose, tcp_to_cam_tf);
+  tf::poseMsgToTF(params_.world_to_obj_pose, world_to_obj_tf);
+
+  Eigen::Vector3d target;
+  tf::vectorTFToEigen(world_to_obj_tf.getOrigin(), target);
+  ScanCoverageModel coverage (target, params_.coverage_region_size);
+
+  // the sweep poses are the candidates, the camera is assumed to look at the object origin from each of them
+  const std::vector<geometry_msgs::Pose> candidates = scan_traj_poses_;
+  std::vector<Eigen::Vector3d> cam_origins (candidates.size());
+  for (std::size_t i = 0; i < candidates.size(); ++i)
+  {
+    tf::Transform world_to_tcp;
+    tf::poseMsgToTF(candidates[i], world_to_tcp);
+    tf::vectorTFToEigen((world_to_tcp * tcp_to_cam_tf).getOrigin(), cam_origins[i]);
+  }
+
+  // from here on only holds the poses actually scanned, in the order they were visited
+  scan_traj_poses_.clear();
+  std::vector<bool> visited (candidates.size(), false);
 
-      if (move_group_ptr_->execute(my_plan))
+  // Each pose is chosen from the coverage so far, so unlike the fixed sweep, planning and processing can not run
+  // ahead of the robot
+  moveit::core::RobotState start_state (*move_group_ptr_->getCurrentState());
+  std::size_t first_gain = 0;
+  int poses_reached = 0;
+  while (ros::ok())
+  {
+    std::size_t best = candidates.size();
+    std::size_t best_gain = 0;
+    for (std::size_t i = 0; i < candidates.size(); ++i)
+    {
+      if (visited[i])
       {
-        poses_reached++;
+        continue;
       }
-      else
+
+      const std::size_t gain = coverage.expected_gain(cam_origins[i], target);
+      if (best == candidates.size() || gain > best_gain)
       {
-        if (params_.stop_on_planning_error)
-        {
-          ROS_ERROR_STREAM("Path Execution to scan position " << i << " failed, quitting scan");
-          break;
-        }
-        else
-        {
-          ROS_WARN_STREAM("Path Execution to scan position " << i << " failed, skipping scan");
-          continue;
-        }
+        best = i;
+        best_gain = gain;
       }
+    }
+
+    if (best == candidates.size())
+    {
+      break;
+    }
+
+    if (first_gain > 0 && best_gain < params_.min_coverage_gain * first_gain)
+    {
+      ROS_INFO_STREAM("Best remaining scan position adds " << best_gain << " of " << first_gain
+                      << " voxels, coverage complete after " << poses_reached << " scans");
+      break;
+    }
+
+    visited[best] = true;
+    ROS_INFO_STREAM("Moving to scan position " << best + 1 << ", expected to observe " << best_gain
+                    << " new voxels");
 
-      if (!move_only)
+    Plan plan;
+    if (!cached_plan_to_pose(start_state, candidates[best], plan))
+    {
+      if (params_.stop_on_planning_error)
       {
-        // get message
-        ros::Duration(1.0).sleep();
-        sensor_msgs::PointCloud2ConstPtr msg = ros::topic::waitForMessage<sensor_msgs::PointCloud2>(
-            params_.scan_topic, ros::Duration(WAIT_MSG_DURATION));
-        pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_ptr(new pcl::PointCloud<pcl::PointXYZRGB>());
-        tf::StampedTransform source_to_target_tf;
-        if (msg)
-        {
-          ROS_INFO_STREAM("Cloud message received, converting to target frame '"
-                          << params_.scan_target_frame << "'");
-
-          // convert to message to point cloud
-          pcl::fromROSMsg<pcl::PointXYZRGB>(*msg, *cloud_ptr);
-
-          // removed nans
-          std::vector<int> index;
-          pcl::removeNaNFromPointCloud(*cloud_ptr, *cloud_ptr, index);
-
-          // transforming
-          if (msg->header.frame_id.compare(params_.scan_target_frame) != 0)
-          {
-            try
-            {
-              tf_listener_ptr_->lookupTransform(params_.scan_target_frame, msg->header.frame_id,
-                                                ros::Time(0), source_to_target_tf);
-              pcl_ros::transformPointCloud(*cloud_ptr, *cloud_ptr, source_to_target_tf);
-            }
-            catch (tf::LookupException& e)
-            {
-              ROS_ERROR_STREAM("Transform lookup error, using source frame id '"
-                               << msg->header.frame_id << "'");
-            }
-            catch (tf::ExtrapolationException& e)
-            {
-              ROS_ERROR_STREAM("Transform lookup error, using source frame id '"
-                               << msg->header.frame_id << "'");
-            }
-          }
-
-          for (std::vector<ScanCallback>::iterator i = callback_list_.begin();
-               i != callback_list_.end(); i++)
-          {
-            (*i)(*cloud_ptr);
-          }
-        }
-        else
-        {
-          ROS_ERROR_STREAM("Cloud message not received");
-        }
+        ROS_ERROR_STREAM("Path Planning to scan position " << best + 1 << " failed, quitting scan");
+        break;
       }
-      else
+
+      ROS_WARN_STREAM("Path Planning to scan position " << best + 1 << " failed, skipping scan");
+      continue;
+    }
+
+    if (!move_group_ptr_->execute(plan))
+    {
+      if (params_.stop_on_planning_error)
       {
-        ROS_WARN_STREAM("MOVE_ONLY mode, skipping scan");
+        ROS_ERROR_STREAM("Path Execution to scan position " << best + 1 << " failed, quitting scan");
+        break;
       }
 
-      ros::Duration(0.5f).sleep();
+      ROS_WARN_STREAM("Path Execution to scan position " << best + 1 << " failed, skipping scan");
+      start_state = *move_group_ptr_->getCurrentState();
+      continue;
+    }
+
+    poses_reached++;
+    start_state = trajectoryEndState(start_state, plan.trajectory_);
+    scan_traj_poses_.push_back(candidates[best]);
+
+    ros::Time settle_time;
+    if (!wait_for_settle(settle_time))
+    {
+      ROS_WARN_STREAM("Robot did not settle at scan position " << best + 1 << " within " << SETTLE_TIMEOUT
+                      << "s");
+    }
+
+    sensor_msgs::PointCloud2ConstPtr msg = wait_for_capture(settle_time, ros::Duration(WAIT_MSG_DURATION));
+    if (!msg)
+    {
+      ROS_ERROR_STREAM("Cloud message not received");
+      continue;
+    }
+
+    // the callbacks may modify the cloud, so it is fused first
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_ptr = convert_capture(msg);
+    coverage.insert_cloud(*cloud_ptr, cam_origins[best]);
+    if (first_gain == 0)
+    {
+      first_gain = best_gain;
+    }
+
+    for (std::vector<ScanCallback>::iterator i = callback_list_.begin(); i != callback_list_.end(); i++)
+    {
+      (*i)(*cloud_ptr);
     }
   }
 
   return poses_reached;
 }
 
+void RobotScan::process_capture(const sensor_msgs::PointCloud2ConstPtr& msg)
+{
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_ptr = convert_capture(msg);
+  for (std::vector<ScanCallback>::iterator i = callback_list_.begin(); i != callback_list_.end(); i++)
+  {
+    (*i)(*cloud_ptr);
+  }
+}
+
+pcl::PointCloud<pcl::PointXYZRGB>::Ptr RobotScan::convert_capture(const sensor_msgs::PointCloud2ConstPtr& msg)
+{
+  ROS_INFO_STREAM("Cloud message received, converting to target frame '"
+                  << params_.scan_target_frame << "'");
+
+  // convert to message to point cloud
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_ptr(new pcl::PointCloud<pcl::PointXYZRGB>());
+  pcl::fromROSMsg<pcl::PointXYZRGB>(*msg, *cloud_ptr);
+
+  // removed nans
+  std::vector<int> index;
+  pcl::removeNaNFromPointCloud(*cloud_ptr, *cloud_ptr, index);
+
+  // transforming with the sensor pose at the time the cloud was taken
+  if (msg->header.frame_id.compare(params_.scan_target_frame) != 0)
+  {
+    try
+    {
+      tf::StampedTransform source_to_target_tf;
+      tf_listener_ptr_->waitForTransform(params_.scan_target_frame, msg->header.frame_id, msg->header.stamp,
+                                         ros::Duration(WAIT_MSG_DURATION));
+      tf_listener_ptr_->lookupTransform(params_.scan_target_frame, msg->header.frame_id,
+                                        msg->header.stamp, source_to_target_tf);
+      pcl_ros::transformPointCloud(*cloud_ptr, *cloud_ptr, source_to_target_tf);
+    }
+    catch (tf::TransformException& e)
+    {
+      ROS_ERROR_STREAM("Transform lookup error, using source frame id '"
+                       << msg->header.frame_id << "'");
+    }
+  }
+
+  return cloud_ptr;
+}
+
 MoveGroupPtr RobotScan::get_move_group() { return move_group_ptr_; }
 
 bool RobotScan::create_scan_trajectory(std::vector<geometry_msgs::Pose>& scan_poses,
@@ -362,6 +793,7 @@ bool RobotScan::create_scan_trajectory(std::vector<geometry_msgs::Pose>& scan_po
   }
 
   move_group_ptr_->setEndEffectorLink(params_.tcp_frame);
+  planning_group_ptr_->setEndEffectorLink(params_.tcp_frame);
 
   return true;
 }
@@ -0,0 +1,209 @@
+#include <scan/scan_coverage_model.h>
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace godel_surface_detection
+{
+namespace scan
+{
+
+const int ScanCoverageModel::GRID_CELLS = 64;
+const int ScanCoverageModel::RAYS_PER_AXIS = 32;
+const double ScanCoverageModel::FOV_HALF_ANGLE = 0.5; // ~29 degrees
+
+ScanCoverageModel::ScanCoverageModel(const Eigen::Vector3d& center, double size)
+  : min_corner_(center - Eigen::Vector3d::Constant(0.5 * size))
+  , max_corner_(center + Eigen::Vector3d::Constant(0.5 * size))
+  , voxel_size_(size / GRID_CELLS)
+  , cells_(GRID_CELLS * GRID_CELLS * GRID_CELLS, UNKNOWN)
+{
+}
+
+void ScanCoverageModel::insert_cloud(const pcl::PointCloud<pcl::PointXYZRGB>& cloud,
+                                     const Eigen::Vector3d& origin)
+{
+  // hits first, so that no ray of this capture carves a surface another one of its points landed on
+  for (std::size_t i = 0; i < cloud.points.size(); ++i)
+  {
+    const pcl::PointXYZRGB& pt = cloud.points[i];
+    std::size_t index;
+    if (pcl_isfinite(pt.x) && to_index(Eigen::Vector3d(pt.x, pt.y, pt.z), index))
+    {
+      cells_[index] = OCCUPIED;
+    }
+  }
+
+  // every ray is carved, rays to points beyond the region still cross it
+  std::vector<std::size_t> ray;
+  for (std::size_t i = 0; i < cloud.points.size(); ++i)
+  {
+    const pcl::PointXYZRGB& pt = cloud.points[i];
+    if (!pcl_isfinite(pt.x))
+    {
+      continue;
+    }
+
+    Eigen::Vector3d dir = Eigen::Vector3d(pt.x, pt.y, pt.z) - origin;
+    const double dist = dir.norm();
+    if (dist < std::numeric_limits<double>::epsilon())
+    {
+      continue;
+    }
+    dir /= dist;
+
+    traverse(origin, dir, dist, ray);
+    for (std::size_t k = 0; k < ray.size(); ++k)
+    {
+      if (cells_[ray[k]] == UNKNOWN)
+      {
+        cells_[ray[k]] = FREE;
+      }
+    }
+  }
+}
+
+std::size_t ScanCoverageModel::expected_gain(const Eigen::Vector3d& origin,
+                                             const Eigen::Vector3d& target) const
+{
+  Eigen::Vector3d view = target - origin;
+  if (view.norm() < std::numeric_limits<double>::epsilon())
+  {
+    return 0;
+  }
+  view.normalize();
+
+  // image plane axes
+  const Eigen::Vector3d ref = std::abs(view.z()) < 0.9 ? Eigen::Vector3d::UnitZ() : Eigen::Vector3d::UnitX();
+  const Eigen::Vector3d u = view.cross(ref).normalized();
+  const Eigen::Vector3d v = view.cross(u);
+  const double half_width = std::tan(FOV_HALF_ANGLE);
+
+  // voxels are counted once even when several rays cross them
+  std::vector<bool> counted(cells_.size(), false);
+  std::vector<std::size_t> ray;
+  std::size_t gain = 0;
+
+  for (int i = 0; i < RAYS_PER_AXIS; ++i)
+  {
+    const double a = half_width * (2.0 * i / (RAYS_PER_AXIS - 1) - 1.0);
+    for (int j = 0; j < RAYS_PER_AXIS; ++j)
+    {
+      const double b = half_width * (2.0 * j / (RAYS_PER_AXIS - 1) - 1.0);
+      const Eigen::Vector3d dir = (view + a * u + b * v).normalized();
+
+      traverse(origin, dir, std::numeric_limits<double>::max(), ray);
+      for (std::size_t k = 0; k < ray.size() && cells_[ray[k]] != OCCUPIED; ++k)
+      {
+        if (cells_[ray[k]] == UNKNOWN && !counted[ray[k]])
+        {
+          counted[ray[k]] = true;
+          ++gain;
+        }
+      }
+    }
+  }
+
+  return gain;
+}
+
+void ScanCoverageModel::traverse(const Eigen::Vector3d& origin, const Eigen::Vector3d& dir, double t_max,
+                                 std::vector<std::size_t>& ray) const
+{
+  ray.clear();
+  double t_enter, t_exit;
+  if (!clip_ray(origin, dir, t_enter, t_exit))
+  {
+    return;
+  }
+  t_exit = std::min(t_exit, t_max);
+
+  // Amanatides & Woo voxel walk, starting from the voxel the ray enters the region through
+  const Eigen::Vector3d start = (origin + t_enter * dir - min_corner_) / voxel_size_;
+  int cell[3], step[3];
+  double t_next[3], t_delta[3];
+  for (int k = 0; k < 3; ++k)
+  {
+    cell[k] = std::min(std::max(static_cast<int>(std::floor(start[k])), 0), GRID_CELLS - 1);
+    if (dir[k] > 0.0)
+    {
+      step[k] = 1;
+      t_delta[k] = voxel_size_ / dir[k];
+      t_next[k] = t_enter + (cell[k] + 1 - start[k]) * t_delta[k];
+    }
+    else if (dir[k] < 0.0)
+    {
+      step[k] = -1;
+      t_delta[k] = -voxel_size_ / dir[k];
+      t_next[k] = t_enter + (start[k] - cell[k]) * t_delta[k];
+    }
+    else
+    {
+      step[k] = 0;
+      t_delta[k] = t_next[k] = std::numeric_limits<double>::max();
+    }
+  }
+
+  double t = t_enter;
+  while (t < t_exit)
+  {
+    ray.push_back(cell[0] + GRID_CELLS * (cell[1] + GRID_CELLS * cell[2]));
+
+    const int k = (t_next[0] < t_next[1]) ? (t_next[0] < t_next[2] ? 0 : 2) : (t_next[1] < t_next[2] ? 1 : 2);
+    t = t_next[k];
+    t_next[k] += t_delta[k];
+    cell[k] += step[k];
+    if (cell[k] < 0 || cell[k] >= GRID_CELLS)
+    {
+      break;
+    }
+  }
+}
+
+bool ScanCoverageModel::to_index(const Eigen::Vector3d& p, std::size_t& index) const
+{
+  const Eigen::Vector3d rel = (p - min_corner_) / voxel_size_;
+  if ((rel.array() < 0.0).any() || (rel.array() >= GRID_CELLS).any())
+  {
+    return false;
+  }
+
+  const std::size_t ix = static_cast<std::size_t>(rel.x());
+  const std::size_t iy = static_cast<std::size_t>(rel.y());
+  const std::size_t iz = static_cast<std::size_t>(rel.z());
+  index = ix + GRID_CELLS * (iy + GRID_CELLS * iz);
+  return true;
+}
+
+bool ScanCoverageModel::clip_ray(const Eigen::Vector3d& origin, const Eigen::Vector3d& dir, double& t_enter,
+                                 double& t_exit) const
+{
+  t_enter = 0.0;
+  t_exit = std::numeric_limits<double>::max();
+  for (int k = 0; k < 3; ++k)
+  {
+    if (std::abs(dir[k]) < std::numeric_limits<double>::epsilon())
+    {
+      if (origin[k] < min_corner_[k] || origin[k] > max_corner_[k])
+      {
+        return false;
+      }
+      continue;
+    }
+
+    double t0 = (min_corner_[k] - origin[k]) / dir[k];
+    double t1 = (max_corner_[k] - origin[k]) / dir[k];
+    if (t0 > t1)
+    {
+      std::swap(t0, t1);
+    }
+    t_enter = std::max(t_enter, t0);
+    t_exit = std::min(t_exit, t1);
+  }
+
+  return t_enter < t_exit;
+}
+
+} /* namespace scan */
+} /* namespace godel_surface_detection */
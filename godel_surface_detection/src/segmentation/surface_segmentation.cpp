@@ -46,6 +46,26 @@ SurfaceSegmentation::SurfaceSegmentation(pcl::PointCloud<pcl::PointXYZRGB>::Ptr
 }
 
 
+SurfaceSegmentation::SurfaceSegmentation(pcl::PointCloud<pcl::PointXYZRGB>::Ptr icloud,
+                                         pcl::PointCloud<pcl::Normal>::Ptr inormals)
+{
+  input_cloud_ =  pcl::PointCloud<pcl::PointXYZRGB>::Ptr(new pcl::PointCloud<pcl::PointXYZRGB>);
+  normals_ =  pcl::PointCloud<pcl::Normal>::Ptr(new pcl::PointCloud<pcl::Normal>);
+  setInputCloud(icloud);
+
+  if (inormals && !inormals->empty() && inormals->size() == input_cloud_->size())
+  {
+    pcl::copyPointCloud(*inormals, *normals_);
+  }
+  else
+  {
+    ROS_WARN("Provided normals do not match the input cloud; recomputing them");
+    removeNans();
+    computeNormals();
+  }
+}
+
+
 void SurfaceSegmentation::setInputCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr icloud)
 {
   input_cloud_->clear();
@@ -240,47 +260,48 @@ double  SurfaceSegmentation::getSearchRadius()
 }
 
 
-void SurfaceSegmentation::smoothVector(const std::vector<double> &x_in,
-                                       std::vector<double> &x_out,
-                                       const std::vector<double> &smoothing_coef)
+void SurfaceSegmentation::smoothVector(const std::vector<Eigen::Vector3d> &x_in,
+                                       std::vector<Eigen::Vector3d> &x_out,
+                                       std::vector<Eigen::Vector3d> &scratch,
+                                       int length)
 {
-  int num_coef = smoothing_coef.size();
-  if (num_coef == 0 || num_coef % 2 != 1 || x_in.size() == 0 || x_in.size() <= num_coef)
-  {
-    if(num_coef % 2 == 0)
-      ROS_WARN_STREAM("Filter must have an odd number of coefficients. Vector not smoothed");
+  const int n = x_in.size();
 
-    x_out = x_in;
+  // the kernel may not be wider than the loop itself
+  const int h = std::min(length / 2, (n - 1) / 2);
+  if (n == 0 || h <= 0)
+  {
+    if (&x_out != &x_in)
+      x_out = x_in;
     return;
   }
 
-  double gain = std::accumulate(smoothing_coef.begin(), smoothing_coef.end(), 0);
-  int n = x_in.size();
+  scratch.resize(n);
+  x_out.resize(n);
 
-  // initialize the filter using tail of x_in
-  std::vector<double> xv;
-  for(int j = num_coef - 1; j >= 0; j--)
-    xv.push_back(x_in[n-j-1]);
+  // look-behind box: scratch[i] = sum of x_in[i - h .. i]
+  Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+  for (int k = 0; k <= h; k++)
+    sum += x_in[(n - k) % n];
 
-  // cycle through every and apply the filter
-  for(int j = 1; j < n - 1; j++)
+  scratch[0] = sum;
+  for (int i = 1; i < n; i++)
   {
-    // shift backwards
-    for(int k = 0; k < num_coef - 1; k++)
-      xv[k] = xv[k + 1];
-
-    // get next input to filter which is num_coef/2 in front of current point being smoothed
-    int idx = (j + num_coef / 2) % n;
-    xv[num_coef - 1] = x_in[idx]; // j'th point
-
-    // apply the filter
-    double sum = 0.0;
-    for(int k = 0; k < num_coef; k++)
-      sum += xv[k] * smoothing_coef[k];
-
-    // save point
-    x_out.push_back(sum / gain);
-  } // end for every point
+    sum += x_in[i] - x_in[(i - h - 1 + n) % n];
+    scratch[i] = sum;
+  }
+
+  // look-ahead box over the look-behind sums: x_out[i] = sum of scratch[i .. i + h]
+  const double gain = 1.0 / ((h + 1) * (h + 1));
+  sum.setZero();
+  for (int k = 0; k <= h; k++)
+    sum += scratch[k];
+
+  for (int i = 0; i < n; i++)
+  {
+    x_out[i] = sum * gain;
+    sum += scratch[(i + h + 1) % n] - scratch[i];
+  }
 }
 
 
@@ -289,49 +310,35 @@ void SurfaceSegmentation::smoothPointNormal(std::vector<pcl::PointNormal> &pts_i
                                             int p_length = 13,
                                             int w_length = 31)
 {
-  std::vector<double> x_in, x_out, y_in, y_out, z_in, z_out;
-  std::vector<double> nx_in, nx_out, ny_in, ny_out, nz_in, nz_out;
+  const std::size_t n = pts_in.size();
+  std::vector<Eigen::Vector3d> positions(n), normals(n), scratch(n);
 
-  for(int i = 0; i < pts_in.size(); i++)
+  for(std::size_t i = 0; i < n; i++)
   {
-    x_in.push_back(pts_in[i].x);
-    y_in.push_back(pts_in[i].y);
-    z_in.push_back(pts_in[i].z);
-    nx_in.push_back(pts_in[i].normal_x);
-    ny_in.push_back(pts_in[i].normal_y);
-    nz_in.push_back(pts_in[i].normal_z);
+    positions[i] = Eigen::Vector3d(pts_in[i].x, pts_in[i].y, pts_in[i].z);
+    normals[i] = Eigen::Vector3d(pts_in[i].normal_x, pts_in[i].normal_y, pts_in[i].normal_z);
   }
 
-  // Initialize vectors to the proper length
-  std::vector<double> position_smoother(p_length);
-  std::vector<double> orientation_smoother(w_length);
-
-  // Smoother uses a linearly weighted average for both look-ahead and look-behind
-  for(int i = 1; i < p_length; i++)
-    position_smoother.push_back((i < p_length/2) ? i : (p_length - i));
-
-  for(int i = 1; i < w_length; i++)
-    orientation_smoother.push_back((i < w_length/2) ? i : w_length - i);
-
-  // Smooth Points
-  smoothVector(x_in, x_out, position_smoother);
-  smoothVector(y_in, y_out, position_smoother);
-  smoothVector(z_in, z_out, position_smoother);
-  smoothVector(nx_in, nx_out, orientation_smoother);
-  smoothVector(ny_in, ny_out, orientation_smoother);
-  smoothVector(nz_in, nz_out, orientation_smoother);
+  // Smooth points and normals in place
+  smoothVector(positions, positions, scratch, p_length);
+  smoothVector(normals, normals, scratch, w_length);
 
   // Normalize and push to output vectors
-  for(int i = 0; i < pts_in.size(); i++)
+  pts_out.clear();
+  pts_out.reserve(n);
+  for(std::size_t i = 0; i < n; i++)
   {
     pcl::PointNormal pt;
-    pt.x = x_out[i];
-    pt.y = y_out[i];
-    pt.z = z_out[i];
-    double norm = sqrt(nx_out[i] * nx_out[i] + ny_out[i] * ny_out[i] + nz_out[i] * nz_out[i]);
-    pt.normal_x = nx_out[i] / norm;
-    pt.normal_y = ny_out[i] / norm;
-    pt.normal_z = nz_out[i] / norm;
+    pt.x = positions[i].x();
+    pt.y = positions[i].y();
+    pt.z = positions[i].z();
+    double norm = normals[i].norm();
+    if (norm == 0)
+      norm = 1.0; /* avoid division by zero */
+
+    pt.normal_x = normals[i].x() / norm;
+    pt.normal_y = normals[i].y() / norm;
+    pt.normal_z = normals[i].z() / norm;
     pts_out.push_back(pt);
   }
 }
@@ -349,15 +356,13 @@ bool SurfaceSegmentation::regularizeNormals(const std::vector<pcl::PointNormal>&
   using BasicCloud = pcl::PointCloud<pcl::PointXYZ>;
   using SearchTree = pcl::KdTreeFLANN<PCLPoint>;
 
-  // create cloud of nearby points
-  BasicCloud::Ptr bd_nearby_points(new BasicCloud());
-
   // ============================================================
-  // find points in surface near boundary points
-  pcl::PointIndices::Ptr nearest_inliers (new pcl::PointIndices);
+  // find points in surface near boundary points. Neighborhoods of consecutive boundary points overlap heavily, so
+  // every point of the downsampled cloud is gathered at most once.
+  pcl::PointIndices::Ptr bd_nearby_indices (new pcl::PointIndices);
+  std::vector<bool> visited(input_cloud_downsampled_->size(), false);
   std::vector<int> nearest_indices;
   std::vector<float> nearest_sqrt_dist;
-  BasicCloud::Ptr nearest_points(new BasicCloud());
   pcl::PointXYZ p;
   int found = 0;
 
@@ -379,37 +384,30 @@ bool SurfaceSegmentation::regularizeNormals(const std::vector<pcl::PointNormal>&
     p.y = pf.y;
     p.z = pf.z;
 
-    nearest_indices.clear();
-    nearest_sqrt_dist.clear();
-    nearest_points->clear();
-
     found = kd_tree_->radiusSearchT(p,2*eps,nearest_indices,nearest_sqrt_dist);// kd-tree was built with the downsampled cloud
     if(found == 0)
     {
       continue;
     }
 
-    // inserting points into cloud
-    pcl::copyPointCloud(*input_cloud_downsampled_,nearest_indices,*nearest_points);
-
-    // adding to larget cloud
-    bd_nearby_points->insert(bd_nearby_points->end(),nearest_points->begin(),nearest_points->end());
-
+    // keeping only points not gathered by a previous search
+    for(const int idx : nearest_indices)
+    {
+      if(!visited[idx])
+      {
+        visited[idx] = true;
+        bd_nearby_indices->indices.push_back(idx);
+      }
+    }
   }
 
-  if(bd_nearby_points->empty())
+  if(bd_nearby_indices->indices.empty())
   {
     ROS_WARN("Failed to find points near edge boundary points");
     return false;
   }
 
-  // dowsampling
-  pcl::VoxelGrid<pcl::PointXYZ> vg;
-  vg.setInputCloud(bd_nearby_points);
-  vg.setLeafSize (DOWNSAMPLING_LEAF,DOWNSAMPLING_LEAF,DOWNSAMPLING_LEAF);
-  vg.filter(*bd_nearby_points);
-
-  ROS_INFO("Found %i points near boundary",int(bd_nearby_points->size()));
+  ROS_INFO("Found %i points near boundary",int(bd_nearby_indices->indices.size()));
 
   // ============================================================
   // proceed to estimate plane
@@ -422,13 +420,14 @@ bool SurfaceSegmentation::regularizeNormals(const std::vector<pcl::PointNormal>&
   seg.setMethodType (pcl::SAC_RANSAC);
   seg.setDistanceThreshold(plane_max_dist);
   seg.setMaxIterations(100);
-  seg.setInputCloud(bd_nearby_points);
+  seg.setInputCloud(input_cloud_downsampled_);
+  seg.setIndices(bd_nearby_indices);
   seg.segment(*plane_inliers,*plane_coeffs);
 
   ROS_INFO_STREAM("Surface Plane coefficients "<< plane_coeffs->values[0]<< ", "<<
                   plane_coeffs->values[1]<<", "<< plane_coeffs->values[2]);
 
-  double inlier_percentage = double(plane_inliers->indices.size())/double(bd_nearby_points->size());
+  double inlier_percentage = double(plane_inliers->indices.size())/double(bd_nearby_indices->indices.size());
   if(inlier_percentage <= plane_inlier_threshold)
   {
     ROS_WARN("Only %f of the points near the boundary fall within %f to the surface plane, quitting due to being below threshold of %f",
@@ -667,3 +666,38 @@ void SurfaceSegmentation::getSurfaceClouds(std::vector<pcl::PointCloud<pcl::Poin
     }
   }
 }
+
+
+void SurfaceSegmentation::getSurfaceNormals(std::vector<pcl::PointCloud<pcl::Normal>::Ptr> &surface_normals)
+{
+  surface_normals.clear();
+  pcl::PointCloud<pcl::Normal>::Ptr segment_normals_ptr;
+
+  for (const auto& cluster : clusters_)
+  {
+    if (cluster.indices.size() == 0)
+      continue;
+
+    if (cluster.indices.size() >= MIN_CLUSTER_SIZE)
+    {
+      segment_normals_ptr = pcl::PointCloud<pcl::Normal>::Ptr (new pcl::PointCloud<pcl::Normal>());
+      pcl::copyPointCloud(*normals_, cluster, *segment_normals_ptr);
+      surface_normals.push_back(segment_normals_ptr);
+    }
+  }
+}
+
+
+void SurfaceSegmentation::getSurfaceIndices(std::vector<pcl::PointIndices> &surface_indices)
+{
+  surface_indices.clear();
+
+  for (const auto& cluster : clusters_)
+  {
+    if (cluster.indices.size() == 0)
+      continue;
+
+    if (cluster.indices.size() >= MIN_CLUSTER_SIZE)
+      surface_indices.push_back(cluster);
+  }
+}
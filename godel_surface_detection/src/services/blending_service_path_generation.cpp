@@ -52,13 +52,21 @@ const static std::string BLENDING_SPD_PARAM = PARAM_BASE + BLEND_PARAM_BASE + "b
 const static std::string RETRACT_SPD_PARAM = PARAM_BASE + BLEND_PARAM_BASE + "retract_speed";
 const static std::string TRAVERSE_SPD_PARAM = PARAM_BASE + BLEND_PARAM_BASE + "traverse_speed";
 const static std::string Z_ADJUST_PARAM = PARAM_BASE + BLEND_PARAM_BASE + "z_adjust";
+const static std::string EDGE_SPARSE_PLANNING_PARAM = PARAM_BASE + BLEND_PARAM_BASE + "edge_sparse_planning";
 
 const static std::string APPROACH_DISTANCE_PARAM = PARAM_BASE + SCAN_PARAM_BASE + "approach_distance";
+const static std::string SCAN_SPD_PARAM = PARAM_BASE + SCAN_PARAM_BASE + "scan_speed";
+const static std::string SCAN_TRAVERSE_SPD_PARAM = PARAM_BASE + SCAN_PARAM_BASE + "traverse_speed";
 const static std::string QUALITY_METRIC_PARAM = PARAM_BASE + SCAN_PARAM_BASE + "quality_metric";
 const static std::string WINDOW_WIDTH_PARAM = PARAM_BASE + SCAN_PARAM_BASE + "window_width";
 const static std::string MIN_QA_VALUE_PARAM = PARAM_BASE + SCAN_PARAM_BASE + "min_qa_value";
 const static std::string MAX_QA_VALUE_PARAM = PARAM_BASE + SCAN_PARAM_BASE + "max_qa_value";
 
+// When set, all paths of a type are planned as one chained job instead of one plan per path
+const static std::string JOB_PLANNING_PARAM = PARAM_BASE + "job_planning";
+const static std::string JOB_BLEND_NAME = "job_blend";
+const static std::string JOB_SCAN_NAME = "job_scan";
+
 
 void computeBoundaries(const godel_surface_detection::detection::CloudRGB::Ptr surface_cloud,
                        SurfaceSegmentation& SS,
@@ -127,14 +135,15 @@ inline static bool isScanPath(const std::string& name)
 
 
 bool SurfaceBlendingService::generateEdgePath(godel_surface_detection::detection::CloudRGB::Ptr surface,
+                                              godel_surface_detection::detection::Normals::Ptr normals,
                                               std::vector<geometry_msgs::PoseArray>& result)
 {
   SWRI_PROFILE("gen-edge-path");
   // Send request to edge path generation service
   std::vector<pcl::IndicesPtr> sorted_boundaries;
 
-  // Compute the boundary
-  SurfaceSegmentation SS(surface);
+  // Compute the boundary, reusing the normals computed during surface detection
+  SurfaceSegmentation SS(surface, normals);
 
   SS.setSearchRadius(SEGMENTATION_SEARCH_RADIUS);
   computeBoundaries(surface, SS, sorted_boundaries);
@@ -176,15 +185,18 @@ SurfaceBlendingService::generateProcessPath(const int& id,
                                             ProcessPathResult& result)
 {
   using godel_surface_detection::detection::CloudRGB;
+  using godel_surface_detection::detection::Normals;
 
   std::string name;
   pcl::PolygonMesh mesh;
   CloudRGB::Ptr surface_ptr (new CloudRGB);
+  Normals::Ptr normals_ptr (new Normals);
 
   data_coordinator_.getSurfaceName(id, name);
   data_coordinator_.getSurfaceMesh(id, mesh);
   data_coordinator_.getCloud(godel_surface_detection::data::CloudTypes::surface_cloud, id, *surface_ptr);
-  return generateProcessPath(id, name, mesh, surface_ptr, result);
+  data_coordinator_.getSurfaceNormals(id, *normals_ptr);
+  return generateProcessPath(id, name, mesh, surface_ptr, normals_ptr, result);
 }
 
 static bool generateToolPaths(const godel_msgs::PathPlanningParameters& params,
@@ -244,6 +256,7 @@ SurfaceBlendingService::generateProcessPath(const int& id,
                                             const std::string& name,
                                             const pcl::PolygonMesh& mesh,
                                             godel_surface_detection::detection::CloudRGB::Ptr surface,
+                                            godel_surface_detection::detection::Normals::Ptr normals,
                                             ProcessPathResult& result)
 {
   SWRI_PROFILE("tool-planning");
@@ -253,13 +266,11 @@ SurfaceBlendingService::generateProcessPath(const int& id,
   godel_msgs::PathPlanningParameters params;
   if (!generateBlendPath(params, mesh, blend_result))
   {
-    process_planning_feedback_.last_completed = "Failed to generate blend path for surface " + name;
-    process_planning_server_.publishFeedback(process_planning_feedback_);
+    publishPlanningFeedback("Failed to generate blend path for surface " + name);
   }
   else
   {
-    process_planning_feedback_.last_completed = "Generated blend path for surface " + name;
-    process_planning_server_.publishFeedback(process_planning_feedback_);
+    publishPlanningFeedback("Generated blend path for surface " + name);
 
     // Add the successful blend path to the output
     ProcessPathResult::value_type vt;
@@ -272,13 +283,11 @@ SurfaceBlendingService::generateProcessPath(const int& id,
   // Step 2: Generate Laser Scan Paths
   if (!generateScanPath(params, mesh, scan_result))
   {
-    process_planning_feedback_.last_completed = "Failed to generate scan path for surface " + name;
-    process_planning_server_.publishFeedback(process_planning_feedback_);
+    publishPlanningFeedback("Failed to generate scan path for surface " + name);
   }
   else
   {
-    process_planning_feedback_.last_completed = "Generated scan path for surface " + name;
-    process_planning_server_.publishFeedback(process_planning_feedback_);
+    publishPlanningFeedback("Generated scan path for surface " + name);
 
     // Add the successful scan path to the output
     ProcessPathResult::value_type vt;
@@ -289,15 +298,13 @@ SurfaceBlendingService::generateProcessPath(const int& id,
   }
 
   // Step 3: Generate Edge Paths for the given surface
-  if (!generateEdgePath(surface, edge_result))
+  if (!generateEdgePath(surface, normals, edge_result))
   {
-    process_planning_feedback_.last_completed = "Failed to generate generate edge path(s) for surface " + name;
-    process_planning_server_.publishFeedback(process_planning_feedback_);
+    publishPlanningFeedback("Failed to generate generate edge path(s) for surface " + name);
   }
   else
   {
-    process_planning_feedback_.last_completed = "Generated edge path(s) for surface " + name;
-    process_planning_server_.publishFeedback(process_planning_feedback_);
+    publishPlanningFeedback("Generated edge path(s) for surface " + name);
 
     // Add the edge paths to the results
     ProcessPathResult::value_type vt;
@@ -317,7 +324,8 @@ SurfaceBlendingService::generateProcessPath(const int& id,
 }
 
 godel_surface_detection::TrajectoryLibrary SurfaceBlendingService::generateMotionLibrary(
-    const godel_msgs::PathPlanningParameters& params)
+    const godel_msgs::PathPlanningParameters& params, godel_surface_detection::ProcessJobQueue* queue,
+    const std::vector<double>& start_state)
 {
   SWRI_PROFILE("generate-motion-library");
   std::vector<int> selected_ids;
@@ -329,8 +337,69 @@ godel_surface_detection::TrajectoryLibrary SurfaceBlendingService::generateMotio
   process_path_results_.edge_poses_.clear();
   process_path_results_.scan_poses_.clear();
 
-  for (const auto& id : selected_ids)
+  ros::NodeHandle nh;
+
+  godel_msgs::BlendingPlanParameters blend_params;
+  blend_params.margin = params.margin;
+  blend_params.overlap = params.overlap;
+  blend_params.tool_radius = params.tool_radius;
+  blend_params.discretization = params.discretization;
+  blend_params.safe_traverse_height = params.traverse_height;
+  nh.getParam(SPINDLE_SPEED_PARAM, blend_params.spindle_speed);
+  nh.getParam(APPROACH_SPD_PARAM, blend_params.approach_spd);
+  nh.getParam(BLENDING_SPD_PARAM, blend_params.blending_spd);
+  nh.getParam(RETRACT_SPD_PARAM, blend_params.retract_spd);
+  nh.getParam(TRAVERSE_SPD_PARAM, blend_params.traverse_spd);
+  nh.getParam(Z_ADJUST_PARAM, blend_params.z_adjust);
+  blend_params.sparse_planning = blending_plan_params_.sparse_planning;
+
+  godel_msgs::ScanPlanParameters scan_params;
+  scan_params.scan_width = params.scan_width;
+  scan_params.margin = params.margin;
+  scan_params.overlap = params.overlap;
+  scan_params.scan_width = params.scan_width;
+  nh.getParam(APPROACH_DISTANCE_PARAM, scan_params.approach_distance);
+  nh.getParam(SCAN_SPD_PARAM, scan_params.scan_spd);
+  nh.getParam(SCAN_TRAVERSE_SPD_PARAM, scan_params.traverse_spd);
+  nh.getParam(QUALITY_METRIC_PARAM, scan_params.quality_metric);
+  nh.getParam(WINDOW_WIDTH_PARAM, scan_params.window_width);
+  nh.getParam(MIN_QA_VALUE_PARAM, scan_params.min_qa_value);
+  nh.getParam(MAX_QA_VALUE_PARAM, scan_params.min_qa_value);
+  scan_params.sparse_planning = scan_plan_params_.sparse_planning;
+//  nh.getParam(Z_ADJUST_PARAM, scan_params.z_adjust);
+  scan_params.z_adjust = 0.0; // Until we fix these parameters and do not share them among the
+                              // different processes, I'm only applying this to blend paths.
+
+  // Paths of every selected surface, in planning order, when they are planned as jobs
+  const bool job_planning = nh.param(JOB_PLANNING_PARAM, false);
+  ProcessPathResult job_blend_paths;
+  ProcessPathResult job_scan_paths;
+
+  // Plans go to the library and, if there is one, to the queue of the plans to execute. The surfaces run
+  // in selection order, and blending before edges before scanning within a surface.
+  auto add_plans = [&lib, queue](const ProcessPlanResult& result, std::size_t surface_rank)
+  {
+    for (const auto& plan : result.plans)
+    {
+      lib.get()[plan.first] = plan.second;
+      if (queue)
+      {
+        godel_surface_detection::ProcessJob job;
+        job.priority = static_cast<int>(3 * surface_rank) +
+                       (isBlendingPath(plan.first) ? 0 : isEdgePath(plan.first) ? 1 : 2);
+        job.name = plan.first;
+        job.plan = plan.second;
+        queue->push(job);
+      }
+    }
+  };
+
+  for (std::size_t surface_rank = 0; surface_rank < selected_ids.size(); ++surface_rank)
   {
+    if (queue && queue->cancelled())
+      break;
+
+    const auto& id = selected_ids[surface_rank];
     // Generate motion plan
     ProcessPathResult paths;
     generateProcessPath(id, paths);
@@ -355,50 +424,41 @@ godel_surface_detection::TrajectoryLibrary SurfaceBlendingService::generateMotio
         ROS_ERROR_STREAM("Tried to process an unrecognized path type: " << vt.first);
     }
 
-    ros::NodeHandle nh;
-
-    godel_msgs::BlendingPlanParameters blend_params;
-    blend_params.margin = params.margin;
-    blend_params.overlap = params.overlap;
-    blend_params.tool_radius = params.tool_radius;
-    blend_params.discretization = params.discretization;
-    blend_params.safe_traverse_height = params.traverse_height;
-    nh.getParam(SPINDLE_SPEED_PARAM, blend_params.spindle_speed);
-    nh.getParam(APPROACH_SPD_PARAM, blend_params.approach_spd);
-    nh.getParam(BLENDING_SPD_PARAM, blend_params.blending_spd);
-    nh.getParam(RETRACT_SPD_PARAM, blend_params.retract_spd);
-    nh.getParam(TRAVERSE_SPD_PARAM, blend_params.traverse_spd);
-    nh.getParam(Z_ADJUST_PARAM, blend_params.z_adjust);
-
-    godel_msgs::ScanPlanParameters scan_params;
-    scan_params.scan_width = params.scan_width;
-    scan_params.margin = params.margin;
-    scan_params.overlap = params.overlap;
-    scan_params.scan_width = params.scan_width;
-    nh.getParam(APPROACH_DISTANCE_PARAM, scan_params.approach_distance);
-    nh.getParam(TRAVERSE_SPD_PARAM, scan_params.traverse_spd);
-    nh.getParam(QUALITY_METRIC_PARAM, scan_params.quality_metric);
-    nh.getParam(WINDOW_WIDTH_PARAM, scan_params.window_width);
-    nh.getParam(MIN_QA_VALUE_PARAM, scan_params.min_qa_value);
-    nh.getParam(MAX_QA_VALUE_PARAM, scan_params.min_qa_value);
-//    nh.getParam(Z_ADJUST_PARAM, scan_params.z_adjust);
-    scan_params.z_adjust = 0.0; // Until we fix these parameters and do not share them among the
-                                // different processes, I'm only applying this to blend paths.
+    if (job_planning)
+    {
+      for (const auto& vt : paths.paths)
+      {
+        if (isScanPath(vt.first))
+          job_scan_paths.paths.push_back(vt);
+        else
+          job_blend_paths.paths.push_back(vt);
+      }
+      continue;
+    }
 
     // Generate trajectory plans from motion plan
     {
       SWRI_PROFILE("motion-planning");
       for (std::size_t j = 0; j < paths.paths.size(); ++j)
       {
-        ProcessPlanResult plan = generateProcessPlan(paths.paths[j].first, paths.paths[j].second, blend_params,
-                                                     scan_params);
+        if (queue && queue->cancelled())
+          break;
 
-        for (std::size_t k = 0; k < plan.plans.size(); ++k)
-          lib.get()[plan.plans[k].first] = plan.plans[k].second;
+        ProcessPlanResult plan = generateProcessPlan(paths.paths[j].first, paths.paths[j].second, blend_params,
+                                                     scan_params, start_state);
+        add_plans(plan, surface_rank);
       }
     }
   }
 
+  if (job_planning && !(queue && queue->cancelled()))
+  {
+    SWRI_PROFILE("job-planning");
+    add_plans(generateJobPlan(JOB_BLEND_NAME, job_blend_paths, blend_params, scan_params, start_state), 0);
+    if (!(queue && queue->cancelled()))
+      add_plans(generateJobPlan(JOB_SCAN_NAME, job_scan_paths, blend_params, scan_params, start_state), 0);
+  }
+
   return lib;
 }
 
@@ -407,7 +467,8 @@ ProcessPlanResult
 SurfaceBlendingService::generateProcessPlan(const std::string& name,
                                             const std::vector<geometry_msgs::PoseArray>& poses,
                                             const godel_msgs::BlendingPlanParameters& params,
-                                            const godel_msgs::ScanPlanParameters& scan_params)
+                                            const godel_msgs::ScanPlanParameters& scan_params,
+                                            const std::vector<double>& start_state)
 {
   ProcessPlanResult result;
 
@@ -419,7 +480,10 @@ SurfaceBlendingService::generateProcessPlan(const std::string& name,
   {
     godel_msgs::BlendProcessPlanning srv;
     srv.request.path.segments = poses;
+    srv.request.name = name;
     srv.request.params = params;
+    srv.request.start_state = start_state;
+    srv.request.detection_id = detection_id_;
 
     success = blend_planning_client_.call(srv);
     process_plan = srv.response.plan;
@@ -428,7 +492,12 @@ SurfaceBlendingService::generateProcessPlan(const std::string& name,
   {
     godel_msgs::BlendProcessPlanning srv;
     srv.request.path.segments = poses;
+    srv.request.name = name;
     srv.request.params = params;
+    srv.request.start_state = start_state;
+    srv.request.detection_id = detection_id_;
+    // Edge paths are long and smooth, which is where sparse planning pays off the most
+    srv.request.params.sparse_planning = ros::NodeHandle().param(EDGE_SPARSE_PLANNING_PARAM, true);
 
     success = blend_planning_client_.call(srv);
     process_plan = srv.response.plan;
@@ -437,7 +506,10 @@ SurfaceBlendingService::generateProcessPlan(const std::string& name,
   {
     godel_msgs::KeyenceProcessPlanning srv;
     srv.request.path.segments = poses;
+    srv.request.name = name;
     srv.request.params = scan_params;
+    srv.request.start_state = start_state;
+    srv.request.detection_id = detection_id_;
 
     success = keyence_planning_client_.call(srv);
     process_plan = srv.response.plan;
@@ -457,3 +529,72 @@ SurfaceBlendingService::generateProcessPlan(const std::string& name,
 
   return result;
 }
+
+
+ProcessPlanResult
+SurfaceBlendingService::generateJobPlan(const std::string& name,
+                                        const ProcessPathResult& paths,
+                                        const godel_msgs::BlendingPlanParameters& params,
+                                        const godel_msgs::ScanPlanParameters& scan_params,
+                                        const std::vector<double>& start_state)
+{
+  ProcessPlanResult result;
+  if (paths.paths.empty())
+  {
+    return result;
+  }
+
+  bool success = false;
+  godel_msgs::ProcessPlan process_plan;
+
+  // The first path is the request's own, the remaining ones are chained after it
+  if (isBlendingPath(name))
+  {
+    godel_msgs::BlendProcessPlanning srv;
+    srv.request.path.segments = paths.paths.front().second;
+    srv.request.name = paths.paths.front().first;
+    srv.request.params = params;
+    srv.request.start_state = start_state;
+    srv.request.detection_id = detection_id_;
+    for (std::size_t i = 1; i < paths.paths.size(); ++i)
+    {
+      godel_msgs::ProcessPath path;
+      path.segments = paths.paths[i].second;
+      srv.request.chained_paths.push_back(path);
+      srv.request.chained_names.push_back(paths.paths[i].first);
+    }
+
+    success = blend_planning_client_.call(srv);
+    process_plan = srv.response.plan;
+  }
+  else
+  {
+    godel_msgs::KeyenceProcessPlanning srv;
+    srv.request.path.segments = paths.paths.front().second;
+    srv.request.name = paths.paths.front().first;
+    srv.request.params = scan_params;
+    srv.request.start_state = start_state;
+    srv.request.detection_id = detection_id_;
+    for (std::size_t i = 1; i < paths.paths.size(); ++i)
+    {
+      godel_msgs::ProcessPath path;
+      path.segments = paths.paths[i].second;
+      srv.request.chained_paths.push_back(path);
+      srv.request.chained_names.push_back(paths.paths[i].first);
+    }
+
+    success = keyence_planning_client_.call(srv);
+    process_plan = srv.response.plan;
+  }
+
+  if (success)
+  {
+    result.plans.push_back(ProcessPlanResult::value_type(name, process_plan));
+  }
+  else
+  {
+    ROS_ERROR_STREAM("Failed to plan job: " << name << " of " << paths.paths.size() << " paths");
+  }
+
+  return result;
+}
@@ -0,0 +1,71 @@
+#include <services/process_job_queue.h>
+
+#include <algorithm>
+
+godel_surface_detection::ProcessJobQueue::ProcessJobQueue()
+  : sequence_(0), closed_(false), cancelled_(false)
+{
+}
+
+void godel_surface_detection::ProcessJobQueue::push(const ProcessJob& job)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_ || cancelled_)
+      return;
+
+    Entry entry;
+    entry.job = job;
+    entry.sequence = sequence_++;
+    heap_.push_back(entry);
+    std::push_heap(heap_.begin(), heap_.end(), &ProcessJobQueue::runsAfter);
+  }
+  ready_.notify_one();
+}
+
+bool godel_surface_detection::ProcessJobQueue::pop(ProcessJob& job)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  ready_.wait(lock, [this] { return cancelled_ || closed_ || !heap_.empty(); });
+
+  if (cancelled_ || heap_.empty())
+    return false;
+
+  std::pop_heap(heap_.begin(), heap_.end(), &ProcessJobQueue::runsAfter);
+  job = heap_.back().job;
+  heap_.pop_back();
+  return true;
+}
+
+void godel_surface_detection::ProcessJobQueue::close()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+  }
+  ready_.notify_all();
+}
+
+void godel_surface_detection::ProcessJobQueue::cancel()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cancelled_ = true;
+    heap_.clear();
+  }
+  ready_.notify_all();
+}
+
+bool godel_surface_detection::ProcessJobQueue::cancelled() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cancelled_;
+}
+
+bool godel_surface_detection::ProcessJobQueue::runsAfter(const Entry& a, const Entry& b)
+{
+  // std heaps keep the greatest element on top, so the job to run next must compare greatest
+  if (a.job.priority != b.job.priority)
+    return a.job.priority > b.job.priority;
+  return a.sequence > b.sequence;
+}
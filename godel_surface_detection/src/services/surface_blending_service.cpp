@@ -10,6 +10,7 @@
 
 #include <godel_param_helpers/godel_param_helpers.h>
 #include <godel_utils/ensenso_guard.h>
+#include <thread>
 
 // topics and services
 const static std::string SAVE_DATA_BOOL_PARAM = "save_data";
@@ -40,6 +41,8 @@ const static std::string SELECTED_SURFACES_CHANGED_TOPIC = "selected_surfaces_ch
 const static std::string ROBOT_SCAN_PATH_PREVIEW_TOPIC = "robot_scan_path_preview";
 const static std::string PUBLISH_REGION_POINT_CLOUD = "publish_region_point_cloud";
 const static std::string REGION_POINT_CLOUD_TOPIC = "region_colored_cloud";
+const static std::string PART_COLLISION_OBJECT_TOPIC = "collision_object";
+const static std::string PART_COLLISION_OBJECT_ID = "scanned_part";
 
 const static std::string EDGE_IDENTIFIER = "_edge_";
 
@@ -67,6 +70,9 @@ const static std::string SCAN_EXE_ACTION_SERVER_NAME = "scan_process_execution_a
 const static std::string PROCESS_PLANNING_ACTION_SERVER_NAME = "process_planning_as";
 const static std::string SELECT_MOTION_PLAN_ACTION_SERVER_NAME = "select_motion_plan_as";
 const static int PROCESS_EXE_BUFFER = 5;  // Additional time [s] buffer between when blending should end and timeout
+const static double PROCESS_EXE_POLL_PERIOD = 0.1; // [s] how often a running execution checks for preemption
+const static std::string JOINT_STATES_TOPIC = "joint_states";
+const static double JOINT_STATE_WAIT_TIME = 2.0; // [s]
 
 SurfaceBlendingService::SurfaceBlendingService() : publish_region_point_cloud_(false), save_data_(false),
   blend_exe_client_(BLEND_EXE_ACTION_SERVER_NAME, true),
@@ -74,7 +80,8 @@ SurfaceBlendingService::SurfaceBlendingService() : publish_region_point_cloud_(f
   process_planning_server_(nh_, PROCESS_PLANNING_ACTION_SERVER_NAME,
                            boost::bind(&SurfaceBlendingService::processPlanningActionCallback, this, _1), false),
   select_motion_plan_server_(nh_, SELECT_MOTION_PLAN_ACTION_SERVER_NAME,
-                             boost::bind(&SurfaceBlendingService::selectMotionPlansActionCallback, this, _1), false)
+                             boost::bind(&SurfaceBlendingService::selectMotionPlansActionCallback, this, _1), false),
+  joint_states_(new godel_utils::JointStateCache(JOINT_STATES_TOPIC))
 {}
 
 bool SurfaceBlendingService::init()
@@ -187,6 +194,7 @@ bool SurfaceBlendingService::init()
   blend_visualization_pub_ = nh_.advertise<geometry_msgs::PoseArray>(BLEND_VISUALIZATION_TOPIC, 1, true);
   edge_visualization_pub_ = nh_.advertise<geometry_msgs::PoseArray>(EDGE_VISUALIZATION_TOPIC, 1, true);
   scan_visualization_pub_ = nh_.advertise<geometry_msgs::PoseArray>(SCAN_VISUALIZATION_TOPIC, 1, true);
+  part_collision_pub_ = nh_.advertise<moveit_msgs::CollisionObject>(PART_COLLISION_OBJECT_TOPIC, 1, true);
 
   // action servers
   process_planning_server_.start();
@@ -223,6 +231,8 @@ bool SurfaceBlendingService::load_blend_parameters(const std::string& filename)
   }
   // otherwise default to the parameter server
   ros::NodeHandle nh("~/blending_plan");
+  // Optional, so that parameter files predating it still load
+  blending_plan_params_.sparse_planning = nh.param("sparse_planning", false);
   return loadParam(nh, "tool_radius", blending_plan_params_.tool_radius) &&
          loadParam(nh, "margin", blending_plan_params_.margin) &&
          loadParam(nh, "overlap", blending_plan_params_.overlap) &&
@@ -277,6 +287,8 @@ bool SurfaceBlendingService::load_scan_parameters(const std::string& filename)
 
   // otherwise we load default parameters from the param server
   ros::NodeHandle nh("~/scan_plan");
+  // Optional, so that parameter files predating it still load
+  scan_plan_params_.sparse_planning = nh.param("sparse_planning", false);
   return loadParam(nh, "traverse_speed", scan_plan_params_.traverse_spd) &&
          loadParam(nh, "margin", scan_plan_params_.margin) &&
          loadParam(nh, "overlap", scan_plan_params_.overlap) &&
@@ -339,17 +351,23 @@ bool SurfaceBlendingService::find_surfaces(visualization_msgs::MarkerArray& surf
     // adding meshes to server
     std::vector<pcl::PolygonMesh> meshes;
     std::vector<godel_surface_detection::detection::CloudRGB::Ptr> surface_clouds;
+    std::vector<godel_surface_detection::detection::Normals::Ptr> surface_normals;
+    std::vector<pcl::PointIndices> surface_indices;
     godel_surface_detection::detection::CloudRGB input_cloud;
     godel_surface_detection::detection::CloudRGB process_cloud;
     surface_detection_.get_meshes(meshes);
     surface_detection_.get_full_cloud(input_cloud);
     surface_detection_.get_surface_clouds(surface_clouds);
+    surface_detection_.get_surface_normals(surface_normals);
+    surface_detection_.get_surface_indices(surface_indices);
     surface_detection_.get_process_cloud(process_cloud);
     data_coordinator_.setProcessCloud(process_cloud);
 
 
     // Meshes and Surface Clouds should be organized identically (e.g. Mesh0 corresponds to Surface0)
     ROS_ASSERT(meshes.size() == surface_clouds.size());
+    ROS_ASSERT(surface_normals.size() == surface_clouds.size());
+    ROS_ASSERT(surface_indices.size() == surface_clouds.size());
     for (std::size_t i = 0; i < meshes.size(); i++)
     {
       pcl::PolygonMesh surface_mesh = meshes[i];
@@ -358,6 +376,8 @@ bool SurfaceBlendingService::find_surfaces(visualization_msgs::MarkerArray& surf
       std::string name = surface_server_.add_surface(id, surface_mesh);
       data_coordinator_.setSurfaceMesh(id, surface_mesh);
       data_coordinator_.setSurfaceName(id, name);
+      data_coordinator_.setSurfaceNormals(id, *(surface_normals[i]));
+      data_coordinator_.setSurfaceIndices(id, surface_indices[i]);
     }
 
     // Save the Data Coordinator's Records
@@ -374,9 +394,29 @@ bool SurfaceBlendingService::find_surfaces(visualization_msgs::MarkerArray& surf
     latest_surface_detection_results_.surfaces = surfaces;
     robot_scan_.get_latest_scan_poses(latest_surface_detection_results_.robot_scan_poses);
 
+    // the process planners must not warm-start the new surfaces from the solutions of the old ones
+    ++detection_id_;
+
     // saving region colored point cloud
     region_cloud_msg_ = sensor_msgs::PointCloud2();
     surface_detection_.get_region_colored_cloud(region_cloud_msg_);
+
+    // the scanned part replaces the fixed safe height for transitions and joins MoveIt's collision checks
+    moveit_msgs::CollisionObject part;
+    if (surface_detection_.params_.use_octomap &&
+        surface_detection_.get_part_collision_object(PART_COLLISION_OBJECT_ID, part))
+    {
+      part_collision_pub_.publish(part);
+      part_collision_published_ = true;
+    }
+    else if (part_collision_published_)
+    {
+      part.id = PART_COLLISION_OBJECT_ID;
+      part.header.frame_id = surface_detection_.params_.frame_id;
+      part.operation = moveit_msgs::CollisionObject::REMOVE;
+      part_collision_pub_.publish(part);
+      part_collision_published_ = false;
+    }
   }
   else
   {
@@ -562,20 +602,29 @@ void SurfaceBlendingService::processPlanningActionCallback(const godel_msgs::Pro
     case godel_msgs::ProcessPlanningGoal::GENERATE_MOTION_PLAN_AND_PREVIEW:
     {
       ensenso::EnsensoGuard guard; // turns off ensenso for planning and turns it on when this goes out of scope
-      process_planning_feedback_.last_completed = "Recieved request to generate motion plan";
-      process_planning_server_.publishFeedback(process_planning_feedback_);
+      publishPlanningFeedback("Recieved request to generate motion plan");
       trajectory_library_ = generateMotionLibrary(goal_in->params);
-      process_planning_feedback_.last_completed = "Finished planning. Visualizing...";
-      process_planning_server_.publishFeedback(process_planning_feedback_);
+      publishPlanningFeedback("Finished planning. Visualizing...");
       visualizePaths();
       process_planning_result_.succeeded = true;
       process_planning_server_.setSucceeded(process_planning_result_);
       break;
     }
+    case godel_msgs::ProcessPlanningGoal::PLAN_AND_EXECUTE:
+    {
+      publishPlanningFeedback("Recieved request to plan and execute");
+      process_planning_result_.succeeded = planAndExecute(goal_in);
+      if (process_planning_server_.isPreemptRequested())
+        process_planning_server_.setPreempted(process_planning_result_);
+      else if (process_planning_result_.succeeded)
+        process_planning_server_.setSucceeded(process_planning_result_);
+      else
+        process_planning_server_.setAborted(process_planning_result_);
+      break;
+    }
     case godel_msgs::ProcessPlanningGoal::PREVIEW_TOOL_PATH:
     {
-      process_planning_feedback_.last_completed = "Recieved request to preview tool path";
-      process_planning_server_.publishFeedback(process_planning_feedback_);
+      publishPlanningFeedback("Recieved request to preview tool path");
       break;
     }
 
@@ -697,32 +746,120 @@ void SurfaceBlendingService::selectMotionPlansActionCallback(const godel_msgs::S
     return;
   }
 
-  bool is_blend = trajectory_library_.get()[goal_in->name].type == godel_msgs::ProcessPlan::BLEND_TYPE;
+  res.code = executeProcessPlan(trajectory_library_.get()[goal_in->name], goal_in->simulate,
+                                goal_in->wait_for_execution, [] { return false; });
+  if (res.code == godel_msgs::SelectMotionPlanResult::SUCCESS)
+  {
+    select_motion_plan_server_.setSucceeded(res);
+  }
+  else
+  {
+    select_motion_plan_server_.setAborted(res);
+  }
+}
+
+
+int SurfaceBlendingService::executeProcessPlan(const godel_msgs::ProcessPlan& plan, bool simulate,
+                                               bool wait_for_execution, const std::function<bool()>& preempted)
+{
+  bool is_blend = plan.type == godel_msgs::ProcessPlan::BLEND_TYPE;
 
   // Send command to execution server
   godel_msgs::ProcessExecutionActionGoal goal;
-  goal.goal.trajectory_approach = trajectory_library_.get()[goal_in->name].trajectory_approach;
-  goal.goal.trajectory_depart = trajectory_library_.get()[goal_in->name].trajectory_depart;
-  goal.goal.trajectory_process = trajectory_library_.get()[goal_in->name].trajectory_process;
-  goal.goal.wait_for_execution = goal_in->wait_for_execution;
-  goal.goal.simulate = goal_in->simulate;
+  goal.goal.trajectory_approach = plan.trajectory_approach;
+  goal.goal.trajectory_depart = plan.trajectory_depart;
+  goal.goal.trajectory_process = plan.trajectory_process;
+  goal.goal.scan_segment_starts = plan.scan_segment_starts;
+  goal.goal.scan_segment_stops = plan.scan_segment_stops;
+  goal.goal.wait_for_execution = wait_for_execution;
+  goal.goal.simulate = simulate;
 
   actionlib::SimpleActionClient<godel_msgs::ProcessExecutionAction> *exe_client =
       (is_blend ? &blend_exe_client_ : &scan_exe_client_);
   exe_client->sendGoal(goal.goal);
 
+  // Wait in short slices so that a preemption can stop the robot mid-motion
   ros::Duration process_time(goal.goal.trajectory_depart.points.back().time_from_start);
   ros::Duration buffer_time(PROCESS_EXE_BUFFER);
-  if(exe_client->waitForResult(process_time + buffer_time))
+  const ros::Time deadline = ros::Time::now() + process_time + buffer_time;
+  while (ros::Time::now() < deadline)
   {
-    res.code = godel_msgs::SelectMotionPlanResult::SUCCESS;
-    select_motion_plan_server_.setSucceeded(res);
+    if (exe_client->waitForResult(ros::Duration(PROCESS_EXE_POLL_PERIOD)))
+    {
+      // A finished goal may still have been aborted, or the robot may not have reached the end of the plan
+      const godel_msgs::ProcessExecutionResultConstPtr result = exe_client->getResult();
+      if (exe_client->getState() != actionlib::SimpleClientGoalState::SUCCEEDED || !result || !result->success)
+      {
+        return godel_msgs::SelectMotionPlanResult::EXECUTION_FAILED;
+      }
+      return godel_msgs::SelectMotionPlanResult::SUCCESS;
+    }
+    if (preempted())
+    {
+      exe_client->cancelGoal();
+      return godel_msgs::SelectMotionPlanResult::TIMEOUT;
+    }
   }
-  else
+  return godel_msgs::SelectMotionPlanResult::TIMEOUT;
+}
+
+
+bool SurfaceBlendingService::planAndExecute(const godel_msgs::ProcessPlanningGoalConstPtr& goal)
+{
+  ensenso::EnsensoGuard guard; // turns off ensenso for planning and turns it on when this goes out of scope
+
+  // Every plan starts from and returns to the state the robot is in now. Plans made while an earlier one
+  // runs would otherwise start from wherever the robot happened to be mid-motion.
+  const sensor_msgs::JointStateConstPtr start_state =
+      joint_states_->waitForState(ros::WallDuration(JOINT_STATE_WAIT_TIME));
+  if (!start_state)
   {
-    res.code=godel_msgs::SelectMotionPlanResult::TIMEOUT;
-    select_motion_plan_server_.setAborted(res);
+    ROS_ERROR("No joint state received; cannot plan and execute.");
+    return false;
   }
+
+  // Planning runs in the background and hands each plan over as soon as it is ready
+  godel_surface_detection::ProcessJobQueue queue;
+  godel_surface_detection::TrajectoryLibrary library;
+  std::thread planner([this, &queue, &library, &goal, &start_state] {
+    library = generateMotionLibrary(goal->params, &queue, start_state->position);
+    queue.close();
+  });
+
+  auto preempted = [this] { return process_planning_server_.isPreemptRequested() || !ros::ok(); };
+
+  bool succeeded = true;
+  godel_surface_detection::ProcessJob job;
+  while (queue.pop(job))
+  {
+    if (preempted())
+    {
+      queue.cancel();
+      break;
+    }
+
+    publishPlanningFeedback("Executing " + job.name);
+
+    if (executeProcessPlan(job.plan, goal->simulate, true, preempted) != godel_msgs::SelectMotionPlanResult::SUCCESS)
+    {
+      ROS_ERROR_STREAM("Execution of " << job.name << " failed or was cancelled. Stopping the remaining jobs.");
+      queue.cancel();
+      succeeded = false;
+    }
+  }
+
+  planner.join();
+  trajectory_library_ = library;
+  visualizePaths();
+  return succeeded && !preempted();
+}
+
+
+void SurfaceBlendingService::publishPlanningFeedback(const std::string& status)
+{
+  std::lock_guard<std::mutex> lock(feedback_mutex_);
+  process_planning_feedback_.last_completed = status;
+  process_planning_server_.publishFeedback(process_planning_feedback_);
 }
 
 
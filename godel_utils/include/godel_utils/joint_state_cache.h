@@ -0,0 +1,65 @@
+#ifndef JOINT_STATE_CACHE_H
+#define JOINT_STATE_CACHE_H
+
+#include <ros/callback_queue.h>
+#include <ros/node_handle.h>
+#include <ros/spinner.h>
+#include <sensor_msgs/JointState.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+namespace godel_utils
+{
+
+/**
+ * Keeps the latest message of a joint state topic, fed by one subscription that lives as long as the
+ * cache. Messages are received on a spinner of their own, so callers may block in a ROS callback of
+ * a single threaded node while waiting for the robot.
+ */
+class JointStateCache
+{
+public:
+  typedef std::function<bool(const sensor_msgs::JointState&)> Predicate;
+
+  explicit JointStateCache(const std::string& topic);
+  ~JointStateCache();
+
+  JointStateCache(const JointStateCache&) = delete;
+  JointStateCache& operator=(const JointStateCache&) = delete;
+
+  /**
+   * The most recent joint state, or null if none has arrived yet. Does not block.
+   */
+  sensor_msgs::JointStateConstPtr latest() const;
+
+  /**
+   * Blocks until a joint state satisfies 'predicate' or 'timeout' (wall time) expires. The latest state
+   * is tested first, then each new arrival.
+   * @return The state that satisfied 'predicate', or null on timeout
+   */
+  sensor_msgs::JointStateConstPtr waitFor(const Predicate& predicate, const ros::WallDuration& timeout) const;
+
+  /**
+   * Blocks until any joint state is available or 'timeout' expires; null on timeout
+   */
+  sensor_msgs::JointStateConstPtr waitForState(const ros::WallDuration& timeout) const;
+
+private:
+  void callback(const sensor_msgs::JointStateConstPtr& state);
+
+  ros::NodeHandle nh_;
+  ros::CallbackQueue queue_;
+  ros::Subscriber sub_;
+  ros::AsyncSpinner spinner_;
+
+  // Readers load the latest state atomically; the mutex only serves the condition variable of the waiters
+  sensor_msgs::JointStateConstPtr latest_;
+  mutable std::mutex mutex_;
+  mutable std::condition_variable arrived_;
+};
+
+}
+
+#endif // JOINT_STATE_CACHE_H
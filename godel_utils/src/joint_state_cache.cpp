@@ -0,0 +1,71 @@
+#include <godel_utils/joint_state_cache.h>
+
+#include <boost/smart_ptr/shared_ptr.hpp>
+#include <chrono>
+
+namespace godel_utils
+{
+
+JointStateCache::JointStateCache(const std::string& topic) : spinner_(1, &queue_)
+{
+  nh_.setCallbackQueue(&queue_);
+  sub_ = nh_.subscribe(topic, 1, &JointStateCache::callback, this);
+  spinner_.start();
+}
+
+JointStateCache::~JointStateCache()
+{
+  spinner_.stop();
+  sub_.shutdown();
+}
+
+sensor_msgs::JointStateConstPtr JointStateCache::latest() const
+{
+  return boost::atomic_load(&latest_);
+}
+
+sensor_msgs::JointStateConstPtr JointStateCache::waitFor(const Predicate& predicate,
+                                                         const ros::WallDuration& timeout) const
+{
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::nanoseconds(timeout.toNSec());
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  sensor_msgs::JointStateConstPtr tested;
+  while (ros::ok())
+  {
+    // Only states that have not been tested yet are handed to the predicate
+    sensor_msgs::JointStateConstPtr state = latest();
+    if (state && state != tested)
+    {
+      if (predicate(*state))
+      {
+        return state;
+      }
+      tested = state;
+    }
+
+    if (arrived_.wait_until(lock, deadline) == std::cv_status::timeout && latest() == tested)
+    {
+      break;
+    }
+  }
+  return sensor_msgs::JointStateConstPtr();
+}
+
+sensor_msgs::JointStateConstPtr JointStateCache::waitForState(const ros::WallDuration& timeout) const
+{
+  return waitFor([](const sensor_msgs::JointState&) { return true; }, timeout);
+}
+
+void JointStateCache::callback(const sensor_msgs::JointStateConstPtr& state)
+{
+  boost::atomic_store(&latest_, state);
+
+  // Taking the lock orders the store before any waiter's check, so no arrival is missed
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+  }
+  arrived_.notify_all();
+}
+
+}
@@ -1,6 +1,10 @@
 #include <ros/ros.h>
 
 #include <industrial_robot_simulator_service/SimulateTrajectory.h>
+#include <industrial_robot_simulator_service/EvaluateTrajectories.h>
+#include "trajectory_metrics.h"
+
+#include <map>
 
 #include <actionlib/client/simple_action_client.h>
 #include <control_msgs/FollowJointTrajectoryAction.h>
@@ -26,11 +30,15 @@ class SimulatorService
 {
 public:
   SimulatorService(ros::NodeHandle& nh, const std::string& service_name,
-                   const std::string& action_name)
-      : ac_(action_name, true), service_name_(service_name), scale_factor_(DEFAULT_SCALE_FACTOR)
+                   const std::string& action_name, const std::string& evaluate_service_name,
+                   const std::string& joint_limits_param)
+      : ac_(action_name, true), service_name_(service_name), joint_limits_param_(joint_limits_param),
+        scale_factor_(DEFAULT_SCALE_FACTOR)
   {
     execute_trajectory_service_ =
         nh.advertiseService(service_name_, &SimulatorService::simulateTrajectoryCallback, this);
+    evaluate_trajectories_service_ =
+        nh.advertiseService(evaluate_service_name, &SimulatorService::evaluateTrajectoriesCallback, this);
 
     // Establish connection to robot action server
     if (!ac_.waitForServer(ros::Duration(ACTION_SERVER_WAIT_TIME)))
@@ -89,6 +97,39 @@ public:
     return true;
   }
 
+  // Evaluates trajectories from their waypoints alone; the simulated robot does not move. Metrics are
+  // reported at the trajectories' nominal timing, i.e. not scaled by the simulator's time-factor.
+  bool evaluateTrajectoriesCallback(industrial_robot_simulator_service::EvaluateTrajectories::Request& req,
+                                    industrial_robot_simulator_service::EvaluateTrajectories::Response& res)
+  {
+    const ros::WallTime start = ros::WallTime::now();
+    res.total_cycle_time = 0.0;
+
+    // Limits are read once per request and joint set, so a changed parameter set needs no restart while
+    // a whole library costs only one round of parameter server lookups
+    std::map<std::vector<std::string>, JointLimitsMap> limits;
+    for (const auto& traj : req.trajectories)
+    {
+      auto it = limits.find(traj.joint_names);
+      if (it == limits.end())
+      {
+        it = limits.emplace(traj.joint_names, loadJointLimits(joint_limits_param_, traj.joint_names)).first;
+      }
+      res.metrics.push_back(evaluateTrajectory(traj, it->second));
+      res.total_cycle_time += res.metrics.back().cycle_time;
+
+      for (const auto& violation : res.metrics.back().violations)
+      {
+        ROS_WARN_STREAM("Trajectory " << res.metrics.size() - 1 << ": " << violation);
+      }
+    }
+
+    ROS_INFO_STREAM("Evaluated " << req.trajectories.size() << " trajectories (" << res.total_cycle_time
+                                 << " s of motion) in " << (ros::WallTime::now() - start).toSec() * 1000.0
+                                 << " ms");
+    return true;
+  }
+
   double scaleFactor() const { return scale_factor_; }
 
   void setScaleFactor(double scale)
@@ -102,7 +143,9 @@ public:
 private:
   actionlib::SimpleActionClient<control_msgs::FollowJointTrajectoryAction> ac_;
   ros::ServiceServer execute_trajectory_service_;
+  ros::ServiceServer evaluate_trajectories_service_;
   std::string service_name_;
+  std::string joint_limits_param_;
   double scale_factor_;
 };
 }
@@ -116,13 +159,18 @@ int main(int argc, char** argv)
   // Load parameters
   std::string service_name;
   std::string action_name;
+  std::string evaluate_service_name;
+  std::string joint_limits_param;
   double scale_factor;
 
   pnh.param<std::string>("service_name", service_name, "simulate_trajectory");
   pnh.param<std::string>("action_name", action_name, "joint_trajectory_action");
+  pnh.param<std::string>("evaluate_service_name", evaluate_service_name, "evaluate_trajectories");
+  pnh.param<std::string>("joint_limits_param", joint_limits_param, "/robot_description_planning/joint_limits");
 
   // Initialize the service
-  industrial_robot_simulator_service::SimulatorService service(nh, service_name, action_name);
+  industrial_robot_simulator_service::SimulatorService service(nh, service_name, action_name,
+                                                               evaluate_service_name, joint_limits_param);
 
   // Optionally load a new default scale factor
   if (pnh.getParam("scale_factor", scale_factor))
@@ -0,0 +1,177 @@
+#include "trajectory_metrics.h"
+
+#include <ros/param.h>
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace
+{
+// Tracks the largest excess over a limit for one joint
+struct WorstExcess
+{
+  WorstExcess() : value(0.0), limit(0.0), excess(0.0), time(0.0), found(false) {}
+
+  // 'e' is how far 'v' lies beyond 'lim'; it is only recorded if positive and the largest so far
+  void update(double v, double lim, double e, double t)
+  {
+    if (e > excess)
+    {
+      value = v;
+      limit = lim;
+      excess = e;
+      time = t;
+      found = true;
+    }
+  }
+
+  // Symmetric limit on the magnitude of 'v'
+  void update(double v, double lim, double t) { update(v, lim, std::abs(v) - lim, t); }
+
+  double value;
+  double limit;
+  double excess;
+  double time;
+  bool found;
+};
+
+void reportExcess(const WorstExcess& w, const std::string& joint, const std::string& kind,
+                  industrial_robot_simulator_service::TrajectoryMetrics& metrics)
+{
+  if (!w.found)
+    return;
+
+  std::ostringstream ss;
+  ss << joint << ": " << kind << " " << w.value << " exceeds limit " << w.limit << " at t = " << w.time << " s";
+  metrics.violations.push_back(ss.str());
+}
+}
+
+industrial_robot_simulator_service::JointLimitsMap
+industrial_robot_simulator_service::loadJointLimits(const std::string& ns,
+                                                    const std::vector<std::string>& joint_names)
+{
+  JointLimitsMap limits;
+  for (const auto& name : joint_names)
+  {
+    const std::string prefix = ns + "/" + name + "/";
+    JointLimits l;
+    ros::param::param(prefix + "has_position_limits", l.has_position_limits, false);
+    ros::param::param(prefix + "min_position", l.min_position, 0.0);
+    ros::param::param(prefix + "max_position", l.max_position, 0.0);
+    ros::param::param(prefix + "has_velocity_limits", l.has_velocity_limits, false);
+    ros::param::param(prefix + "max_velocity", l.max_velocity, 0.0);
+    ros::param::param(prefix + "has_acceleration_limits", l.has_acceleration_limits, false);
+    ros::param::param(prefix + "max_acceleration", l.max_acceleration, 0.0);
+    limits[name] = l;
+  }
+  return limits;
+}
+
+industrial_robot_simulator_service::TrajectoryMetrics
+industrial_robot_simulator_service::evaluateTrajectory(const trajectory_msgs::JointTrajectory& traj,
+                                                       const JointLimitsMap& limits)
+{
+  const std::size_t n_joints = traj.joint_names.size();
+
+  TrajectoryMetrics metrics;
+  metrics.cycle_time = 0.0;
+  metrics.peak_velocity.assign(n_joints, 0.0);
+  metrics.peak_acceleration.assign(n_joints, 0.0);
+
+  if (traj.points.empty())
+  {
+    metrics.within_limits = true;
+    return metrics;
+  }
+
+  metrics.cycle_time = (traj.points.back().time_from_start - traj.points.front().time_from_start).toSec();
+
+  std::vector<JointLimits> joint_limits(n_joints);
+  for (std::size_t j = 0; j < n_joints; ++j)
+  {
+    const auto it = limits.find(traj.joint_names[j]);
+    if (it != limits.end())
+      joint_limits[j] = it->second;
+  }
+
+  std::vector<WorstExcess> worst_pos(n_joints), worst_vel(n_joints), worst_acc(n_joints);
+  std::vector<double> prev_vel(n_joints, 0.0);
+  double prev_dt = 0.0;
+  bool have_prev_vel = false;
+  bool time_ok = true;
+
+  for (std::size_t i = 0; i < traj.points.size(); ++i)
+  {
+    const auto& pt = traj.points[i];
+    const double t = pt.time_from_start.toSec();
+    if (pt.positions.size() != n_joints)
+    {
+      std::ostringstream ss;
+      ss << "point " << i << " has " << pt.positions.size() << " positions for " << n_joints << " joints";
+      metrics.violations.push_back(ss.str());
+      metrics.within_limits = false;
+      return metrics;
+    }
+
+    for (std::size_t j = 0; j < n_joints; ++j)
+    {
+      const JointLimits& l = joint_limits[j];
+      if (l.has_position_limits)
+      {
+        worst_pos[j].update(pt.positions[j], l.min_position, l.min_position - pt.positions[j], t);
+        worst_pos[j].update(pt.positions[j], l.max_position, pt.positions[j] - l.max_position, t);
+      }
+    }
+
+    if (i == 0)
+      continue;
+
+    // Segment velocities are taken at the segment midpoints, accelerations between two such midpoints
+    const auto& prev = traj.points[i - 1];
+    const double dt = (pt.time_from_start - prev.time_from_start).toSec();
+    if (dt <= 0.0)
+    {
+      if (time_ok)
+      {
+        std::ostringstream ss;
+        ss << "time does not advance between points " << i - 1 << " and " << i;
+        metrics.violations.push_back(ss.str());
+        time_ok = false;
+      }
+      have_prev_vel = false;
+      continue;
+    }
+
+    const double t_mid = prev.time_from_start.toSec() + 0.5 * dt;
+    for (std::size_t j = 0; j < n_joints; ++j)
+    {
+      const double v = (pt.positions[j] - prev.positions[j]) / dt;
+      metrics.peak_velocity[j] = std::max(metrics.peak_velocity[j], std::abs(v));
+      if (joint_limits[j].has_velocity_limits)
+        worst_vel[j].update(v, joint_limits[j].max_velocity, t_mid);
+
+      if (have_prev_vel)
+      {
+        const double a = (v - prev_vel[j]) / (0.5 * (dt + prev_dt));
+        metrics.peak_acceleration[j] = std::max(metrics.peak_acceleration[j], std::abs(a));
+        if (joint_limits[j].has_acceleration_limits)
+          worst_acc[j].update(a, joint_limits[j].max_acceleration, prev.time_from_start.toSec());
+      }
+      prev_vel[j] = v;
+    }
+    prev_dt = dt;
+    have_prev_vel = true;
+  }
+
+  for (std::size_t j = 0; j < n_joints; ++j)
+  {
+    reportExcess(worst_pos[j], traj.joint_names[j], "position", metrics);
+    reportExcess(worst_vel[j], traj.joint_names[j], "velocity", metrics);
+    reportExcess(worst_acc[j], traj.joint_names[j], "acceleration", metrics);
+  }
+
+  metrics.within_limits = metrics.violations.empty();
+  return metrics;
+}
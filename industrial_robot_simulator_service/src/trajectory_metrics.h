@@ -0,0 +1,43 @@
+#ifndef TRAJECTORY_METRICS_H
+#define TRAJECTORY_METRICS_H
+
+#include <industrial_robot_simulator_service/TrajectoryMetrics.h>
+#include <trajectory_msgs/JointTrajectory.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace industrial_robot_simulator_service
+{
+
+// Limits of one joint; a limit is only checked if its flag is set
+struct JointLimits
+{
+  JointLimits()
+      : has_position_limits(false), min_position(0.0), max_position(0.0), has_velocity_limits(false),
+        max_velocity(0.0), has_acceleration_limits(false), max_acceleration(0.0)
+  {
+  }
+
+  bool has_position_limits;
+  double min_position;
+  double max_position;
+  bool has_velocity_limits;
+  double max_velocity;
+  bool has_acceleration_limits;
+  double max_acceleration;
+};
+
+typedef std::map<std::string, JointLimits> JointLimitsMap;
+
+// Reads limits in the layout of MoveIt's joint_limits.yaml ('ns'/<joint>/max_velocity, ...) for the given joints.
+// Joints without an entry are left unlimited.
+JointLimitsMap loadJointLimits(const std::string& ns, const std::vector<std::string>& joint_names);
+
+// Computes cycle time and peak joint velocity and acceleration of 'traj' at its nominal timing, and checks
+// them against 'limits'
+TrajectoryMetrics evaluateTrajectory(const trajectory_msgs::JointTrajectory& traj, const JointLimitsMap& limits);
+}
+
+#endif
@@ -5,8 +5,9 @@
  * The input is a PolygonBoundary which defines the 2d points comprising
  * a hole-less surface
  *
- * The output is a set of dense points which, when packaged with the associated
- * pose of the surface, are suitable for trajectory planning.
+ * The output is a set of segments of dense points which, when packaged with the
+ * associated pose of the surface, are suitable for trajectory planning. Segments
+ * are separated by empty space the robot should traverse rather than scan.
  */
 #ifndef PROFILOMETER_SCAN_H
 #define PROFILOMETER_SCAN_H
@@ -18,7 +19,7 @@ namespace path_planning_plugins
 namespace scan
 {
 
-std::vector<godel_process_path::PolygonPt>
+std::vector<std::vector<godel_process_path::PolygonPt> >
 generateProfilometerScanPath(const godel_process_path::PolygonBoundary& boundary,
                              const godel_msgs::PathPlanningParameters& params);
 
@@ -63,39 +63,30 @@ bool openveronoi::ScanPlanner::generatePath(std::vector<geometry_msgs::PoseArray
     if (filtered_boundaries.empty())
       return false;
 
-    geometry_msgs::PoseArray scan_poses;
-
-    // 4 - Generate scan polygon boundary
-    PolygonBoundary scan_boundary = scan::generateProfilometerScanPath(filtered_boundaries.front(), params);
+    // 4 - Generate scan path segments
+    std::vector<PolygonBoundary> scan_segments =
+        scan::generateProfilometerScanPath(filtered_boundaries.front(), params);
 
     // 5 - Get boundary pose eigen
     Eigen::Affine3d boundary_pose_eigen;
     tf::poseMsgToEigen(boundary_pose, boundary_pose_eigen);
 
-    // 6 - Transform points to world frame and generate pose
-    std::vector<geometry_msgs::Point> points;
-
-    for(const auto& pt : scan_boundary)
+    // 6 - Transform points to world frame and generate poses, one pose array per segment
+    for (const auto& segment : scan_segments)
     {
-      geometry_msgs::Point p;
-      p.x = pt.x;
-      p.y = pt.y;
-      p.z = 0.0;
-
-      points.push_back(p);
+      geometry_msgs::PoseArray scan_poses;
+      std::transform(segment.begin(), segment.end(), std::back_inserter(scan_poses.poses),
+                     [boundary_pose_eigen] (const godel_process_path::PolygonPt& pt) {
+        geometry_msgs::Pose pose;
+        Eigen::Affine3d r = boundary_pose_eigen * Eigen::Translation3d(pt.x, pt.y, 0.0);
+        tf::poseEigenToMsg(r, pose);
+        return pose;
+      });
+      path.push_back(scan_poses);
     }
 
-    std::transform(points.begin(), points.end(), std::back_inserter(scan_poses.poses),
-                   [boundary_pose_eigen] (const geometry_msgs::Point& point) {
-      geometry_msgs::Pose pose;
-      Eigen::Affine3d r = boundary_pose_eigen * Eigen::Translation3d(point.x, point.y, point.z);
-      tf::poseEigenToMsg(r, pose);
-      return pose;
-    });
-
-    // 8 - return result
-    path.push_back(scan_poses);
-    return true;
+    // 7 - return result
+    return !path.empty();
   }
   else
     ROS_WARN_STREAM("Could not calculate boundary for mesh");
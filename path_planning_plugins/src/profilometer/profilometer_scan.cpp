@@ -1,5 +1,7 @@
 #include <profilometer/profilometer_scan.h>
 #include <ros/io.h>
+#include <algorithm>
+#include <limits>
 
 // Factor by which the length and width of the bounding box are
 // multiplied to generate a scan path that covers the entire object
@@ -10,6 +12,10 @@ static const double GROWTH_FACTOR = 1.1;
 // in the scan trajectory
 static const double SCAN_DISCRETIZATION = 0.01; // 1 cm
 
+// Empty spans along a stripe shorter than this are scanned through, longer
+// ones split the path so the robot can traverse them instead
+static const double MIN_SKIP_GAP = 0.05; // 5 cm
+
 namespace path_planning_plugins
 {
 namespace scan
@@ -30,28 +36,86 @@ struct RotatedRect
 };
 
 
-RotatedRect simpleBoundingBox(const Boundary& boundary)
+/**
+ * Convex hull of the boundary points (Andrew's monotone chain), counter-clockwise
+ */
+std::vector<Pt> convexHull(const Boundary& boundary)
 {
-  double min_x = boundary[0].x;
-  double min_y = boundary[0].y;
-  double max_x = boundary[0].x;
-  double max_y = boundary[0].y;
+  std::vector<Pt> pts(boundary.begin(), boundary.end());
+  std::sort(pts.begin(), pts.end(), [](const Pt& a, const Pt& b) {
+    return a.x < b.x || (a.x == b.x && a.y < b.y);
+  });
+  pts.erase(std::unique(pts.begin(), pts.end()), pts.end());
+  if (pts.size() < 3)
+    return pts;
 
-  for (std::size_t i = 1; i < boundary.size(); ++i)
+  std::vector<Pt> hull(2 * pts.size());
+  std::size_t k = 0;
+  // lower hull
+  for (std::size_t i = 0; i < pts.size(); ++i)
   {
-    const Pt& pt = boundary[i];
-    min_x = std::min(pt.x, min_x);
-    min_y = std::min(pt.y, min_y);
-    max_x = std::max(pt.x, max_x);
-    max_y = std::max(pt.y, max_y);
+    while (k >= 2 && (hull[k - 1] - hull[k - 2]).cross(pts[i] - hull[k - 2]) <= 0)
+      --k;
+    hull[k++] = pts[i];
   }
+  // upper hull
+  for (std::size_t i = pts.size() - 1, t = k + 1; i > 0; --i)
+  {
+    while (k >= t && (hull[k - 1] - hull[k - 2]).cross(pts[i - 1] - hull[k - 2]) <= 0)
+      --k;
+    hull[k++] = pts[i - 1];
+  }
+  hull.resize(k - 1);
+  return hull;
+}
+
+/**
+ * Minimum width bounding box of the boundary. The narrowest box has a side collinear
+ * with an edge of the convex hull (rotating calipers), so each hull edge direction is
+ * tried. Stripes run along the box (w), which minimizes the number of passes.
+ */
+RotatedRect minimumWidthBoundingBox(const Boundary& boundary)
+{
+  const std::vector<Pt> hull = convexHull(boundary);
 
   RotatedRect result;
-  result.a = 0.0; // non-rotated, hence the simple bounding box
-  result.x = (max_x + min_x) / 2;
-  result.y = (max_y + min_y) / 2;
-  result.w = max_x - min_x;
-  result.h = max_y - min_y;
+  result.a = 0.0;
+  result.x = hull.front().x;
+  result.y = hull.front().y;
+  result.w = 0.0;
+  result.h = 0.0;
+
+  double min_width = std::numeric_limits<double>::max();
+  for (std::size_t i = 0; i < hull.size(); ++i)
+  {
+    const Pt edge = hull[(i + 1) % hull.size()] - hull[i];
+    const double length = edge.norm();
+    if (length < std::numeric_limits<double>::epsilon())
+      continue;
+
+    const Pt u = edge * (1.0 / length);
+    const Pt v(-u.y, u.x);
+    double min_u = std::numeric_limits<double>::max(), max_u = -min_u;
+    double min_v = std::numeric_limits<double>::max(), max_v = -min_v;
+    for (std::size_t j = 0; j < hull.size(); ++j)
+    {
+      min_u = std::min(min_u, hull[j].dot(u));
+      max_u = std::max(max_u, hull[j].dot(u));
+      min_v = std::min(min_v, hull[j].dot(v));
+      max_v = std::max(max_v, hull[j].dot(v));
+    }
+
+    if (max_v - min_v < min_width)
+    {
+      min_width = max_v - min_v;
+      const Pt center = u * ((min_u + max_u) / 2) + v * ((min_v + max_v) / 2);
+      result.a = std::atan2(u.y, u.x);
+      result.x = center.x;
+      result.y = center.y;
+      result.w = max_u - min_u;
+      result.h = max_v - min_v;
+    }
+  }
 
   // grow region a little
   result.w *= GROWTH_FACTOR;
@@ -105,6 +169,66 @@ std::vector<RotatedRect> sliceBoundingBox(const RotatedRect& bbox, double slice_
   return slices;
 }
 
+/**
+ * Spans [start, end] along the axis of the slice, measured from its center, over which a
+ * scan of the given half width covers part of the boundary. Gaps shorter than MIN_SKIP_GAP
+ * are closed and each span is extended by 'extension' on both ends, within the slice.
+ */
+std::vector<std::pair<double, double> > clipSliceToBoundary(const RotatedRect& slice,
+                                                            const Boundary& boundary,
+                                                            double half_width, double extension)
+{
+  const Pt c(slice.x, slice.y);
+  const Pt u(std::cos(slice.a), std::sin(slice.a));
+  const Pt v(-u.y, u.x);
+
+  // boundary in slice coordinates
+  std::vector<Pt> local;
+  local.reserve(boundary.size());
+  for (std::size_t i = 0; i < boundary.size(); ++i)
+    local.push_back(Pt((boundary[i] - c).dot(u), (boundary[i] - c).dot(v)));
+
+  // intersect lines across the width of the scan with the boundary
+  std::vector<std::pair<double, double> > spans;
+  const int n_lines = std::max(2, static_cast<int>(std::ceil(2 * half_width / SCAN_DISCRETIZATION)) + 1);
+  std::vector<double> crossings;
+  for (int l = 0; l < n_lines; ++l)
+  {
+    const double line_v = -half_width + 2 * half_width * l / (n_lines - 1);
+    crossings.clear();
+    for (std::size_t i = 0; i < local.size(); ++i)
+    {
+      const Pt& p = local[i];
+      const Pt& q = local[(i + 1) % local.size()];
+      if ((p.y > line_v) != (q.y > line_v))
+        crossings.push_back(p.x + (line_v - p.y) * (q.x - p.x) / (q.y - p.y));
+    }
+
+    std::sort(crossings.begin(), crossings.end());
+    for (std::size_t i = 0; i + 1 < crossings.size(); i += 2)
+      spans.push_back(std::make_pair(crossings[i], crossings[i + 1]));
+  }
+
+  std::sort(spans.begin(), spans.end());
+
+  std::vector<std::pair<double, double> > merged;
+  for (std::size_t i = 0; i < spans.size(); ++i)
+  {
+    if (!merged.empty() && spans[i].first - extension <= merged.back().second + extension + MIN_SKIP_GAP)
+      merged.back().second = std::max(merged.back().second, spans[i].second);
+    else
+      merged.push_back(spans[i]);
+  }
+
+  for (std::size_t i = 0; i < merged.size(); ++i)
+  {
+    merged[i].first = std::max(merged[i].first - extension, -slice.w / 2);
+    merged[i].second = std::min(merged[i].second + extension, slice.w / 2);
+  }
+
+  return merged;
+}
+
 std::vector<Pt> interpolateAlongAxis(const RotatedRect& rect, double ds)
 {
   std::vector<Pt> pts;
@@ -156,63 +280,76 @@ std::vector<Pt> makeStitch(const Pt& a, const Pt& b, double ds)
   return result;
 }
 
-std::vector<Pt> stitchAndFlatten(const std::vector<std::vector<Pt> >& paths, double ds)
-{
-  std::vector<Pt> result;
-  bool forward = true;
-  for (std::size_t i = 0; i < paths.size(); ++i)
-  {
-    // copy current path in given direction
-    if (forward)
-    {
-      result.insert(result.end(), paths[i].begin(), paths[i].end());
-    }
-    else
-    {
-      result.insert(result.end(), paths[i].rbegin(), paths[i].rend());
-    }
-
-    forward = !forward;
-
-    // check to see if there is a next strip
-    if (i + 1 < paths.size())
-    {
-      // if so, stitch to the next point
-      std::vector<Pt> stitch = makeStitch(
-          *result.rbegin(), (forward ? *(paths[i + 1].begin()) : *(paths[i + 1].rbegin())), ds);
-      result.insert(result.end(), stitch.begin(), stitch.end());
-    }
-  }
-  return result;
-}
-
-
-std::vector<Pt>
+std::vector<std::vector<Pt> >
 generateProfilometerScanPath(const Boundary& boundary, const PlanningParams& params)
 {
-  std::vector<Pt> pts;
+  std::vector<std::vector<Pt> > segments;
   if (boundary.empty())
   {
     ROS_WARN("Cannot generate profilometer scan paths for empty boundary.");
-    return pts;
+    return segments;
   }
 
-  // Step 1 -> compute axis-aligned bounding box; we rely on our reference pose for orientation
-  RotatedRect bbox = simpleBoundingBox(boundary);
+  // Step 1 -> compute the minimum width bounding box, stripes run along its length
+  RotatedRect bbox = minimumWidthBoundingBox(boundary);
+  const double extension = 0.5 * bbox.w * (1.0 - 1.0 / GROWTH_FACTOR);
 
   // Step 2 -> slice bounding box into strips
   std::vector<RotatedRect> slices = sliceBoundingBox(bbox, params.scan_width, params.overlap);
 
-  // Step 3 -> generate set of dense points along center of each strip
-  std::vector<std::vector<Pt> > slice_points;
-  slice_points.reserve(slices.size());
+  // Step 3 -> generate dense points over the spans of each strip that cover the surface, and
+  // connect them boustrophedon style. Connections that would cross more than MIN_SKIP_GAP of
+  // empty space start a new segment, which planning turns into a traverse.
+  const double max_stitch = (params.scan_width - params.overlap) + MIN_SKIP_GAP;
+  std::vector<Pt> current;
+  bool forward = true;
   for (std::size_t i = 0; i < slices.size(); ++i)
-    slice_points.push_back(interpolateAlongAxis(slices[i], SCAN_DISCRETIZATION));
+  {
+    std::vector<std::pair<double, double> > spans =
+        clipSliceToBoundary(slices[i], boundary, params.scan_width / 2, extension);
+    if (spans.empty())
+      continue;
 
-  // Step 4 -> connect slices together
-  pts = stitchAndFlatten(slice_points, SCAN_DISCRETIZATION);
+    if (!forward)
+      std::reverse(spans.begin(), spans.end());
 
-  return pts;
+    for (std::size_t j = 0; j < spans.size(); ++j)
+    {
+      const double mid = (spans[j].first + spans[j].second) / 2;
+      RotatedRect span = slices[i];
+      span.x += std::cos(span.a) * mid;
+      span.y += std::sin(span.a) * mid;
+      span.w = spans[j].second - spans[j].first;
+
+      std::vector<Pt> span_points = interpolateAlongAxis(span, SCAN_DISCRETIZATION);
+      if (span_points.empty())
+        continue;
+      if (!forward)
+        std::reverse(span_points.begin(), span_points.end());
+
+      if (!current.empty())
+      {
+        if (current.back().dist(span_points.front()) <= max_stitch)
+        {
+          std::vector<Pt> stitch = makeStitch(current.back(), span_points.front(), SCAN_DISCRETIZATION);
+          current.insert(current.end(), stitch.begin(), stitch.end());
+        }
+        else
+        {
+          segments.push_back(current);
+          current.clear();
+        }
+      }
+      current.insert(current.end(), span_points.begin(), span_points.end());
+    }
+
+    forward = !forward;
+  }
+
+  if (!current.empty())
+    segments.push_back(current);
+
+  return segments;
 }
 
 } // end namespace scan